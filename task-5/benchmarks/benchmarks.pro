@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+# Command line tools that measure parts of the task-5 pipeline. They include
+# the headers from the parent directory and do not need a display.
+SUBDIRS += \
+    kernels \
+    objload \
+    render
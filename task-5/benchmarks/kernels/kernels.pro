@@ -0,0 +1,14 @@
+QT       += core gui concurrent
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../../fixedpoint.h \
+    ../../halfspace.h \
+    ../../renderer.h
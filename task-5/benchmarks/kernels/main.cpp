@@ -0,0 +1,210 @@
+// Measures the triangle fill kernels on single triangles of a given area,
+// aspect ratio and depth test pass rate, and prints one CSV row per case.
+//
+// Usage: kernels [--size WxH] [--min-time ms] [--kernel name ...]
+//
+// Every case draws copies of one triangle side by side over the target, so
+// no copy overwrites another, and restores the depth buffer between
+// batches. Areas go from 1 pixel to a triangle spanning the whole target.
+// The depth buffer passes the test on the left pass-rate fraction of the
+// target and fails it on the rest, so occlusion is coherent like in a
+// scene. Columns:
+//   kernel, area_px, aspect (width / height of the bounding box),
+//   depth_pass, copies (triangles per batch), ns_per_triangle (median over
+//   batches), mpixels_per_s (area / time)
+
+#include "fixedpoint.h"
+#include "halfspace.h"
+#include "renderer.h"
+#include "rendertarget.h"
+#include "scene.h"
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+using Kernel = std::function<void(Renderer &, RenderTarget &,
+                                  const QVector3D &, const QVector3D &,
+                                  const QVector3D &)>;
+
+struct NamedKernel {
+    QString name;
+    bool member; // Draws into the Renderer's target rather than its own
+    Kernel fill;
+};
+
+const QRgb Color = 0xff336699;
+
+QVector<NamedKernel> allKernels() {
+    QVector<NamedKernel> kernels;
+    kernels.append({"bbox", true,
+                    [](Renderer &r, RenderTarget &, const QVector3D &a,
+                       const QVector3D &b, const QVector3D &c) {
+                        r.fillTriangle(a, b, c, Color);
+                    }});
+    kernels.append({"bbox-depth", true,
+                    [](Renderer &r, RenderTarget &, const QVector3D &a,
+                       const QVector3D &b, const QVector3D &c) {
+                        r.fillTriangleWithDepth(a, b, c, Color);
+                    }});
+    kernels.append({"scanline", true,
+                    [](Renderer &r, RenderTarget &, const QVector3D &a,
+                       const QVector3D &b, const QVector3D &c) {
+                        r.fillTriangleScanLine(a, b, c, Color,
+                                               r.targetRect());
+                    }});
+    kernels.append(
+        {"halfspace-scalar", false,
+         [](Renderer &, RenderTarget &t, const QVector3D &a,
+            const QVector3D &b, const QVector3D &c) {
+             HalfSpaceRasterizer::fillTriangleScalar(
+                 t, a, b, c, Color, QRect(0, 0, t.width(), t.height()));
+         }});
+    if (HalfSpaceRasterizer::hasAvx2()) {
+        kernels.append(
+            {"halfspace-avx2", false,
+             [](Renderer &, RenderTarget &t, const QVector3D &a,
+                const QVector3D &b, const QVector3D &c) {
+                 HalfSpaceRasterizer::fillTriangle(
+                     t, a, b, c, Color, QRect(0, 0, t.width(), t.height()));
+             }});
+    }
+    kernels.append(
+        {"fixedpoint", false,
+         [](Renderer &, RenderTarget &t, const QVector3D &a,
+            const QVector3D &b, const QVector3D &c) {
+             FixedPointRasterizer::fillTriangle(
+                 t, a, b, c, Color, QRect(0, 0, t.width(), t.height()));
+         }});
+    return kernels;
+}
+
+// Depth buffer that a triangle at depth 1 to 1.5 passes on the left
+// passRate of the target and fails on the rest
+void resetDepth(RenderTarget &target, double passRate) {
+    int passing = int(std::lround(passRate * target.width()));
+    for (int y = 0; y < target.height(); ++y) {
+        float *row = target.depthScanLine(y);
+        std::fill(row, row + passing, 2.0f);
+        std::fill(row + passing, row + target.width(), 0.5f);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QTextStream out(stdout);
+    int width = 1280, height = 720;
+    double minTimeMs = 20;
+    QStringList selected;
+    for (int i = 1; i < argc; ++i) {
+        QString arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            QStringList size = QString(argv[++i]).split('x');
+            if (size.size() == 2) {
+                width = size[0].toInt();
+                height = size[1].toInt();
+            }
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            minTimeMs = std::max(0.0, QString(argv[++i]).toDouble());
+        } else if (arg == "--kernel" && i + 1 < argc) {
+            selected.append(argv[++i]);
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        out << "Invalid size " << width << "x" << height << "\n";
+        return 1;
+    }
+
+    // The member kernels draw into the Renderer's target, so the prepared
+    // target is swapped in for them
+    Scene scene;
+    Renderer renderer(&scene, width, height);
+    RenderTarget target(width, height);
+    target.clear(0xffffffff);
+
+    // Areas from 1 pixel up, then the largest triangle that fits
+    QVector<double> areas;
+    for (double area = 1; area < width * height / 2.0; area *= 4) {
+        areas.append(area);
+    }
+    const double aspects[] = {1.0 / 16, 1.0 / 4, 1, 4, 16};
+    const double passRates[] = {0, 0.5, 1};
+
+    out << "kernel,area_px,aspect,depth_pass,copies,ns_per_triangle,"
+           "mpixels_per_s\n";
+    for (const NamedKernel &kernel : allKernels()) {
+        if (!selected.isEmpty() && !selected.contains(kernel.name))
+            continue;
+        for (int a = 0; a <= areas.size(); ++a) {
+            bool full = a == areas.size();
+            for (double aspect : aspects) {
+                // Bounding box of width w and height h; the full-target
+                // triangle only comes with the target's aspect
+                double w, h;
+                if (full) {
+                    if (aspect != 1)
+                        continue;
+                    w = width - 1;
+                    h = height - 1;
+                } else {
+                    h = std::sqrt(2 * areas[a] / aspect);
+                    w = aspect * h;
+                }
+                if (w > width - 1 || h > height - 1)
+                    continue;
+                double area = w * h / 2;
+
+                // Copies on a grid of whole pixels, at a subpixel offset
+                int cellW = int(std::ceil(w)) + 1;
+                int cellH = int(std::ceil(h)) + 1;
+                QVector<QVector3D> corners;
+                for (int cy = 0; cy + cellH <= height || cy == 0;
+                     cy += cellH) {
+                    for (int cx = 0; cx + cellW <= width || cx == 0;
+                         cx += cellW) {
+                        float x = cx + 0.37f, y = cy + 0.61f;
+                        // Clockwise on screen, for the bounding box kernels
+                        corners.append(QVector3D(x, y, 1.0f));
+                        corners.append(QVector3D(x + w, y, 1.25f));
+                        corners.append(QVector3D(x + 0.3f * w, y + h, 1.5f));
+                    }
+                }
+                int copies = corners.size() / 3;
+
+                for (double passRate : passRates) {
+                    QVector<double> batches; // Nanoseconds per triangle
+                    double totalMs = 0;
+                    while (totalMs < minTimeMs || batches.size() < 3) {
+                        resetDepth(target, passRate);
+                        if (kernel.member)
+                            renderer.swapTarget(target);
+                        QElapsedTimer timer;
+                        timer.start();
+                        for (int i = 0; i < corners.size(); i += 3) {
+                            kernel.fill(renderer, target, corners[i],
+                                        corners[i + 1], corners[i + 2]);
+                        }
+                        qint64 ns = timer.nsecsElapsed();
+                        if (kernel.member)
+                            renderer.swapTarget(target);
+                        batches.append(double(ns) / copies);
+                        totalMs += ns / 1e6;
+                    }
+                    std::sort(batches.begin(), batches.end());
+                    double ns = batches[batches.size() / 2];
+                    out << kernel.name << "," << area << ","
+                        << (full ? w / h : aspect) << "," << passRate << ","
+                        << copies << "," << ns << "," << area / ns * 1e3
+                        << "\n";
+                }
+                out.flush();
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+// Compares ObjLoader with the QTextStream based OBJ reader it replaced, and
+// with loading the same mesh back from MeshCache.
+//
+// Usage: objload [--iterations N] [--threads N] [file.obj ...]
+// Without files a synthetic mesh is generated in the temp directory.
+
+#include "meshcache.h"
+#include "model.h"
+#include "objloader.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// The reader Scene::readFromObjFile used before ObjLoader: triangles only,
+// one QString split per line and per corner
+qint64 loadWithTextStream(const QString &filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+    QTextStream in(&file);
+
+    QVector<QVector3D> points;
+    QVector<QVector3D> trianglePoints;
+    while (!in.atEnd()) {
+        QString line = in.readLine();
+        if (line.startsWith("v ")) {
+            QStringList parts = line.split(' ');
+            if (parts.size() == 4) {
+                points.append(QVector3D(parts[1].toFloat(),
+                                        parts[2].toFloat(),
+                                        parts[3].toFloat()));
+            }
+        } else if (line.startsWith("f ")) {
+            QStringList parts = line.split(' ');
+            if (parts.size() == 4) {
+                for (int i = 1; i < 4; ++i) {
+                    int index = parts[i].split('/')[0].toInt() - 1;
+                    if (index >= 0 && index < points.size())
+                        trianglePoints.append(points[index]);
+                }
+            }
+        }
+    }
+    return trianglePoints.size() / 3;
+}
+
+// Grid of quads with every other row written as two triangles, so both
+// the n-gon and the triangle paths are exercised
+QString generateMesh(int quadsPerSide) {
+    QString filePath = QDir(QDir::tempPath()).filePath("objload-grid.obj");
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return QString();
+
+    QTextStream out(&file);
+    int side = quadsPerSide + 1;
+    for (int y = 0; y < side; ++y) {
+        for (int x = 0; x < side; ++x) {
+            out << "v " << x * 0.5 << " " << y * 0.5 << " "
+                << (x * 7 + y * 3) % 11 * 0.1 << "\n";
+        }
+    }
+    for (int y = 0; y < quadsPerSide; ++y) {
+        for (int x = 0; x < quadsPerSide; ++x) {
+            int a = y * side + x + 1;
+            int b = a + 1, c = a + side + 1, d = a + side;
+            if (y % 2 == 0) {
+                out << "f " << a << " " << b << " " << c << " " << d << "\n";
+            } else {
+                out << "f " << a << " " << b << " " << c << "\n";
+                out << "f " << a << " " << c << " " << d << "\n";
+            }
+        }
+    }
+    return filePath;
+}
+
+// Median wall time in milliseconds over the given number of runs
+double medianMs(int iterations, const std::function<void()> &run) {
+    QVector<double> times;
+    for (int i = 0; i < iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        run();
+        times.append(timer.nsecsElapsed() / 1e6);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QTextStream out(stdout);
+    int iterations = 5;
+    int threads = 0;
+    QStringList files;
+    for (int i = 1; i < argc; ++i) {
+        QString arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, QString(argv[++i]).toInt());
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = QString(argv[++i]).toInt();
+        } else {
+            files.append(arg);
+        }
+    }
+    if (files.isEmpty()) {
+        QString generated = generateMesh(1000);
+        if (generated.isEmpty()) {
+            out << "Could not write the synthetic mesh\n";
+            return 1;
+        }
+        files.append(generated);
+    }
+
+    for (const QString &filePath : files) {
+        double megabytes = QFile(filePath).size() / (1024.0 * 1024.0);
+        out << filePath << " (" << megabytes << " MB)\n";
+
+        qint64 legacyFaces = 0;
+        double legacyMs = medianMs(iterations, [&] {
+            legacyFaces = loadWithTextStream(filePath);
+        });
+
+        ObjMesh mesh;
+        double singleMs = medianMs(
+            iterations, [&] { ObjLoader::load(filePath, mesh, 1); });
+        double parallelMs = medianMs(
+            iterations, [&] { ObjLoader::load(filePath, mesh, threads); });
+
+        // Cache loads include touching every page, as the first frame would
+        Model model(mesh.vertices, mesh.indices);
+        MeshCache::store(filePath, *model.getMesh());
+        volatile quint64 checksum = 0;
+        double cacheMs = medianMs(iterations, [&] {
+            std::shared_ptr<const MeshData> cached = MeshCache::load(filePath);
+            if (!cached)
+                return;
+            quint64 sum = 0;
+            for (quint32 index : cached->indices())
+                sum += index;
+            for (const QVector3D &vertex : cached->vertices()) {
+                quint32 bits;
+                float x = vertex.x();
+                std::memcpy(&bits, &x, sizeof(bits));
+                sum += bits;
+            }
+            checksum = sum;
+        });
+
+        auto report = [&](const char *name, double ms, qint64 faces) {
+            out << "  " << name << ": " << ms << " ms, "
+                << megabytes / (ms / 1000.0) << " MB/s, "
+                << faces / (ms / 1000.0) << " faces/s (" << faces
+                << " faces)\n";
+        };
+        report("QTextStream      ", legacyMs, legacyFaces);
+        report("ObjLoader 1 thread", singleMs, mesh.faceCount);
+        report("ObjLoader parallel", parallelMs, mesh.faceCount);
+        report("MeshCache         ", cacheMs, mesh.faceCount);
+        out.flush();
+    }
+    return 0;
+}
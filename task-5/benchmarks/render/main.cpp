@@ -0,0 +1,392 @@
+// Renders a scene along a camera path without a window and reports frame
+// times and throughput.
+//
+// Usage: render [--size WxH] [--frames N] [--warmup N] [--path file]
+//               [--kernel scanline|halfspace|fixedpoint] [--tiled]
+//               [--images dir] [--trace file.json] [--instances N]
+//               [--animate K] [--lods N] [file.obj ...]
+// Without files the bundled cubes are rendered. --instances repeats the
+// loaded models on a grid until the scene holds N of them, all sharing the
+// meshes of the loaded ones. --animate places every model under a node of
+// a scene graph and spins K of them each frame; the time of the graph update
+// is reported separately from the frame time. --lods simplifies every mesh
+// into N levels of detail and reports the triangles per frame they save.
+// A path file has one frame
+// per line, "x y z yaw pitch": the camera position and its angles in
+// degrees, as set through Camera. Lines starting with # are skipped.
+// Without a path the camera circles the scene once in --frames frames.
+// With --trace the timed frames are profiled: the mean time of each pipeline
+// stage is reported and all stages are written as a Chrome trace.
+//
+// Heap allocations are counted by replacing the global operator new. Frames
+// after the warmup must not allocate at all: in serial mode the tool fails
+// with exit code 2 if any does. Tiled mode hands its tiles to
+// QtConcurrent::blockingMap, which allocates its tasks, so its allocations
+// are only reported. Without warmup frames nothing is checked either, since
+// the first frame sizes the renderer's buffers.
+
+#include "camera.h"
+#include "profiler.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scenegraph.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+std::atomic<qint64> allocationCount{0}; // Calls to operator new so far
+
+struct CameraPose {
+    QVector3D position;
+    float yaw;   // Degrees
+    float pitch; // Degrees
+};
+
+// Poses of a path file, or an empty list if it cannot be read
+QVector<CameraPose> readPath(const QString &filePath) {
+    QVector<CameraPose> path;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return path;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        QStringList parts = line.split(' ', Qt::SkipEmptyParts);
+        if (parts.size() != 5) {
+            qWarning() << "Skipping malformed path line:" << line;
+            continue;
+        }
+        path.append({QVector3D(parts[0].toFloat(), parts[1].toFloat(),
+                               parts[2].toFloat()),
+                     parts[3].toFloat(), parts[4].toFloat()});
+    }
+    return path;
+}
+
+// One turn around the center of the scene, looking at it. The vertex stage
+// puts the eye DepthOffset units behind the camera position.
+QVector<CameraPose> orbitPath(const Scene &scene, int frames) {
+    const float DepthOffset = 300;
+    Aabb bounds;
+    for (int i = 0; i < scene.getModels().size(); ++i) {
+        bounds.extend(scene.getWorldBounds(i));
+    }
+    QVector3D center = bounds.center();
+    float distance = bounds.extent().length(); // Twice the bounding radius
+
+    QVector<CameraPose> path;
+    for (int i = 0; i < frames; ++i) {
+        float yaw = 360.0f * i / frames;
+        QVector3D forward(std::sin(qDegreesToRadians(yaw)), 0,
+                          std::cos(qDegreesToRadians(yaw)));
+        path.append({center - (distance - DepthOffset) * forward, yaw, 0});
+    }
+    return path;
+}
+
+// Add instances of the scene's models until it holds count models, laid out
+// on a square grid in the xz-plane with cells as large as the largest model
+void addGrid(Scene &scene, int count) {
+    int loaded = scene.getModels().size();
+    if (loaded == 0 || count <= loaded)
+        return;
+    float spacing = 0;
+    for (const Model &model : scene.getModels()) {
+        QVector3D extent = model.getBounds().extent();
+        spacing = std::max({spacing, extent.x(), extent.z()});
+    }
+    spacing *= 1.5f;
+    int side = int(std::ceil(std::sqrt(double(count))));
+    scene.reserve(count);
+    for (int i = loaded; i < count; ++i) {
+        QMatrix4x4 transform;
+        transform.translate((i % side) * spacing, 0, (i / side) * spacing);
+        scene.addInstance(i % loaded, transform);
+    }
+}
+
+Camera cameraAt(const CameraPose &pose, float fov) {
+    Camera camera(fov);
+    camera.Translate(pose.position);
+    camera.Rotate(pose.yaw, pose.pitch);
+    return camera;
+}
+
+// Value below which the given fraction of the sorted values lie
+double percentile(const QVector<double> &sorted, double fraction) {
+    int index = int(std::ceil(fraction * sorted.size())) - 1;
+    return sorted[std::clamp(index, 0, int(sorted.size()) - 1)];
+}
+
+} // namespace
+
+// Counting replacements of the global allocation functions. The array and
+// nothrow forms call these by default.
+void *operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    std::size_t align = std::size_t(alignment);
+    if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+
+int main(int argc, char *argv[]) {
+    QTextStream out(stdout);
+    int width = 1280, height = 720;
+    int frames = 120;
+    int warmup = 3;
+    int instances = 0;
+    int animated = 0;
+    int lodLevels = 1;
+    QString pathFile, imageDir, traceFile;
+    Renderer::Settings settings;
+    QStringList files;
+    for (int i = 1; i < argc; ++i) {
+        QString arg = argv[i];
+        if (arg == "--size" && i + 1 < argc) {
+            QStringList size = QString(argv[++i]).split('x');
+            if (size.size() == 2) {
+                width = size[0].toInt();
+                height = size[1].toInt();
+            }
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::max(1, QString(argv[++i]).toInt());
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::max(0, QString(argv[++i]).toInt());
+        } else if (arg == "--path" && i + 1 < argc) {
+            pathFile = argv[++i];
+        } else if (arg == "--kernel" && i + 1 < argc) {
+            QString kernel = argv[++i];
+            if (kernel == "scanline") {
+                settings.fillKernel = Renderer::FillKernel::ScanLine;
+            } else if (kernel == "halfspace") {
+                settings.fillKernel = Renderer::FillKernel::HalfSpace;
+            } else {
+                settings.fillKernel = Renderer::FillKernel::FixedPoint;
+            }
+        } else if (arg == "--tiled") {
+            settings.renderMode = Renderer::RenderMode::Tiled;
+        } else if (arg == "--images" && i + 1 < argc) {
+            imageDir = argv[++i];
+        } else if (arg == "--instances" && i + 1 < argc) {
+            instances = std::max(0, QString(argv[++i]).toInt());
+        } else if (arg == "--animate" && i + 1 < argc) {
+            animated = std::max(0, QString(argv[++i]).toInt());
+        } else if (arg == "--lods" && i + 1 < argc) {
+            lodLevels = std::clamp(QString(argv[++i]).toInt(), 1, 5);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else {
+            files.append(arg);
+        }
+    }
+    if (width <= 0 || height <= 0) {
+        out << "Invalid size " << width << "x" << height << "\n";
+        return 1;
+    }
+
+    Scene scene;
+    if (files.isEmpty()) {
+        // The scene of the application: a cube and a moved copy of it
+        scene.readFromObjFile(":/assets/models/cube.obj");
+        QMatrix4x4 secondCube;
+        secondCube.translate(-30, 0, 200);
+        if (!scene.getModels().isEmpty())
+            scene.addInstance(0, secondCube);
+    }
+    for (const QString &filePath : files) {
+        scene.readFromObjFile(filePath);
+    }
+    if (scene.getModels().isEmpty()) {
+        out << "No models loaded\n";
+        return 1;
+    }
+    QElapsedTimer instancing;
+    instancing.start();
+    addGrid(scene, instances);
+    double instancingMs = instancing.nsecsElapsed() / 1e6;
+    QElapsedTimer simplifying;
+    simplifying.start();
+    if (lodLevels > 1)
+        scene.buildLods(lodLevels);
+    double simplifyingMs = simplifying.nsecsElapsed() / 1e6;
+
+    // One node per model below a shared root, animated by spinning every
+    // step-th node about its own vertical axis
+    SceneGraph graph(&scene);
+    int root = graph.addNode();
+    int modelCount = scene.getModels().size();
+    animated = std::min(animated, modelCount);
+    for (int i = 0; i < modelCount; ++i) {
+        graph.addNode(root, scene.getModelTransform(i), i);
+    }
+    graph.update();
+    int step = animated > 0 ? modelCount / animated : 0;
+
+    qint64 sceneTriangles = 0;
+    QSet<const MeshData *> meshes;
+    for (const Model &model : scene.getModels()) {
+        sceneTriangles += model.getTriangleCount();
+        meshes.insert(model.getMesh().get());
+    }
+
+    QVector<CameraPose> path =
+        pathFile.isEmpty() ? orbitPath(scene, frames) : readPath(pathFile);
+    if (path.isEmpty()) {
+        out << "Could not read the camera path " << pathFile << "\n";
+        return 1;
+    }
+    if (!imageDir.isEmpty() && !QDir().mkpath(imageDir)) {
+        out << "Could not create " << imageDir << "\n";
+        return 1;
+    }
+
+    // Fragments are the pixels covered by the drawn triangles. They are
+    // counted in an untimed pass with the fixed-point kernel, which is the
+    // only one that counts them.
+    Renderer renderer(&scene, width, height);
+    renderer.setSettings(settings);
+    Renderer counter(&scene, width, height);
+    Renderer::Settings counting = settings;
+    counting.fillKernel = Renderer::FillKernel::FixedPoint;
+    counting.hierarchicalZ = false;
+    counting.overdrawCounting = true;
+    counter.setSettings(counting);
+
+    Profiler::setThreadName("main");
+    float fov = scene.getCamera()->getFov();
+    for (int i = 0; i < warmup; ++i) {
+        renderer.renderScene(cameraAt(path[i % path.size()], fov));
+    }
+
+    QVector<double> times;
+    times.reserve(path.size());
+    qint64 allocations = 0;
+    int allocatingFrames = 0;
+    qint64 triangles = 0;
+    qint64 trianglesSaved = 0;
+    qint64 fragments = 0;
+    qint64 updateNanoseconds = 0;
+    qint64 nodesUpdated = 0;
+    for (int i = 0; i < path.size(); ++i) {
+        if (animated > 0) {
+            QElapsedTimer update;
+            update.start();
+            for (int k = 0; k < animated; ++k) {
+                int node = 1 + k * step;
+                QMatrix4x4 local = graph.getLocalTransform(node);
+                local.rotate(3, 0, 1, 0);
+                graph.setLocalTransform(node, local);
+            }
+            nodesUpdated += graph.update();
+            updateNanoseconds += update.nsecsElapsed();
+        }
+
+        Camera camera = cameraAt(path[i], fov);
+        QElapsedTimer timer;
+        timer.start();
+        Profiler::setEnabled(!traceFile.isEmpty());
+        qint64 allocated = allocationCount.load();
+        renderer.renderScene(camera);
+        allocated = allocationCount.load() - allocated;
+        Profiler::setEnabled(false);
+        times.append(timer.nsecsElapsed() / 1e6);
+        allocations += allocated;
+        allocatingFrames += allocated > 0;
+        triangles += renderer.getFrameStats().trianglesDrawn;
+        trianglesSaved += renderer.getFrameStats().trianglesSaved;
+
+        counter.renderScene(camera);
+        fragments += counter.getFrameStats().fragmentsCovered;
+
+        if (!imageDir.isEmpty()) {
+            QString name = QString("frame_%1.png").arg(i, 4, 10, QChar('0'));
+            renderer.getTarget().toImage().save(QDir(imageDir).filePath(name));
+        }
+    }
+
+    double totalSeconds = 0;
+    for (double ms : times) {
+        totalSeconds += ms / 1000.0;
+    }
+    std::sort(times.begin(), times.end());
+
+    out << scene.getModels().size() << " models of " << meshes.size()
+        << " meshes, " << sceneTriangles << " triangles, " << width << "x"
+        << height << ", " << path.size() << " frames\n";
+    if (instances > 0)
+        out << "  instancing: " << instancingMs << " ms\n";
+    if (lodLevels > 1) {
+        out << "  levels of detail: built in " << simplifyingMs
+            << " ms, triangles/frame drawn " << triangles / path.size()
+            << ", saved " << trianglesSaved / path.size() << "\n";
+    }
+    if (animated > 0)
+        out << "  scene graph: " << nodesUpdated / path.size() << " of "
+            << graph.nodeCount() << " nodes updated in "
+            << updateNanoseconds / 1e6 / path.size() << " ms per frame\n";
+    out << "  frame time: min " << times.first() << " ms, median "
+        << percentile(times, 0.5) << " ms, p99 " << percentile(times, 0.99)
+        << " ms\n";
+    out << "  triangles/s: " << triangles / totalSeconds
+        << ", fragments/s: " << fragments / totalSeconds << "\n";
+    out << "  heap allocations: " << allocations << " in "
+        << allocatingFrames << " of " << path.size() << " frames\n";
+    bool allocationFailed = false;
+    if (settings.renderMode == Renderer::RenderMode::Tiled) {
+        out << "    not checked: QtConcurrent allocates the tiled tasks\n";
+    } else if (warmup == 0) {
+        out << "    not checked: no warmup frames\n";
+    } else if (allocations > 0) {
+        out << "    FAILED: steady-state frames allocated\n";
+        allocationFailed = true;
+    }
+    if (!traceFile.isEmpty()) {
+        // The rings only keep the latest scopes, so with many models the
+        // stages are averaged over the frames that are still recorded
+        QVector<Profiler::StageTime> stages =
+            Profiler::summarize(0, Profiler::now());
+        int recorded = 1;
+        for (const Profiler::StageTime &stage : stages) {
+            if (std::strcmp(stage.name, Profiler::Frame) == 0)
+                recorded = stage.count;
+        }
+        out << "  stages (ms per frame, " << recorded << " frames):";
+        for (const Profiler::StageTime &stage : stages) {
+            out << " " << stage.name << " "
+                << stage.nanoseconds / 1e6 / recorded;
+        }
+        out << "\n";
+        if (!Profiler::writeChromeTrace(traceFile))
+            return 1;
+        out << "  trace written to " << traceFile << "\n";
+    }
+    out.flush();
+    return allocationFailed ? 2 : 0;
+}
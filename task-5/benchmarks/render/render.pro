@@ -0,0 +1,15 @@
+QT       += core gui concurrent
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../../renderer.h
+
+RESOURCES += \
+    ../../resources.qrc
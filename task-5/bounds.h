@@ -0,0 +1,97 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "qmatrix4x4.h"
+#include "qvectornd.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Axis-aligned bounding box. A default constructed box is empty and grows to
+// fit the points added to it.
+struct Aabb {
+    QVector3D min = QVector3D(std::numeric_limits<float>::max(),
+                              std::numeric_limits<float>::max(),
+                              std::numeric_limits<float>::max());
+    QVector3D max = QVector3D(std::numeric_limits<float>::lowest(),
+                              std::numeric_limits<float>::lowest(),
+                              std::numeric_limits<float>::lowest());
+
+    bool isEmpty() const {
+        return min.x() > max.x() || min.y() > max.y() || min.z() > max.z();
+    }
+
+    void extend(const QVector3D &p) {
+        min = QVector3D(std::min(min.x(), p.x()), std::min(min.y(), p.y()),
+                        std::min(min.z(), p.z()));
+        max = QVector3D(std::max(max.x(), p.x()), std::max(max.y(), p.y()),
+                        std::max(max.z(), p.z()));
+    }
+
+    void extend(const Aabb &other) {
+        if (!other.isEmpty()) {
+            extend(other.min);
+            extend(other.max);
+        }
+    }
+
+    QVector3D center() const { return (min + max) * 0.5f; }
+
+    QVector3D extent() const { return max - min; }
+
+    // Box around the transformed corners of this box
+    Aabb transformed(const QMatrix4x4 &matrix) const {
+        Aabb box;
+        if (isEmpty())
+            return box;
+        for (int corner = 0; corner < 8; ++corner) {
+            box.extend(matrix.map(QVector3D(corner & 1 ? max.x() : min.x(),
+                                            corner & 2 ? max.y() : min.y(),
+                                            corner & 4 ? max.z() : min.z())));
+        }
+        return box;
+    }
+};
+
+// Sphere enclosing a set of points. A negative radius marks an empty sphere.
+struct BoundingSphere {
+    QVector3D center;
+    float radius = -1;
+
+    bool isEmpty() const { return radius < 0; }
+
+    // Sphere centered on the box that reaches the farthest of the points.
+    // Tighter than the sphere around the box corners for most meshes.
+    template <typename Points>
+    static BoundingSphere around(const Aabb &box, const Points &points) {
+        BoundingSphere sphere;
+        if (box.isEmpty())
+            return sphere;
+        sphere.center = box.center();
+        float radiusSquared = 0;
+        for (const QVector3D &p : points) {
+            radiusSquared =
+                std::max(radiusSquared, (p - sphere.center).lengthSquared());
+        }
+        sphere.radius = std::sqrt(radiusSquared);
+        return sphere;
+    }
+
+    // Sphere around this sphere after an affine transform, scaled by the
+    // largest axis scale of the matrix
+    BoundingSphere transformed(const QMatrix4x4 &matrix) const {
+        BoundingSphere sphere;
+        if (isEmpty())
+            return sphere;
+        float scale = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            scale = std::max(scale,
+                             matrix.column(axis).toVector3D().lengthSquared());
+        }
+        sphere.center = matrix.map(center);
+        sphere.radius = radius * std::sqrt(scale);
+        return sphere;
+    }
+};
+
+#endif // BOUNDS_H
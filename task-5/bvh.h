@@ -0,0 +1,227 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "bounds.h"
+#include "frustum.h"
+#include "qvectornd.h"
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Bounding volume hierarchy over the world bounds of a scene's models. Every
+// leaf holds one item (a model index), and every inner node exactly two
+// children, so a tree over n items has 2n - 1 nodes.
+//
+// build() splits the items at the median centroid along the longest axis of
+// their bounds. refit() updates the bounds of one moved item and its
+// ancestors without changing the shape of the tree; that keeps the tree
+// valid but, after large motions, less tight than a fresh build.
+class SceneBvh {
+  public:
+    void build(const QVector<Aabb> &bounds) {
+        nodes.clear();
+        leafOf = QVector<int>(bounds.size(), -1);
+        rootNode = -1;
+        if (bounds.isEmpty())
+            return;
+
+        QVector<int> items(bounds.size());
+        QVector<QVector3D> centroids(bounds.size());
+        for (int i = 0; i < bounds.size(); ++i) {
+            items[i] = i;
+            centroids[i] = bounds[i].center();
+        }
+        nodes.reserve(2 * bounds.size() - 1);
+        rootNode = buildRange(items, 0, items.size(), bounds, centroids, -1);
+    }
+
+    // Item count the tree was built for
+    int size() const { return leafOf.size(); }
+
+    bool isEmpty() const { return rootNode < 0; }
+
+    // Bounds of the whole scene
+    Aabb bounds() const {
+        return rootNode < 0 ? Aabb() : nodes[rootNode].bounds;
+    }
+
+    // Give an item new bounds and grow or shrink its ancestors to match.
+    // Stops as soon as an ancestor's bounds do not change.
+    void refit(int item, const Aabb &bounds) {
+        int node = leafOf[item];
+        nodes[node].bounds = bounds;
+        for (node = nodes[node].parent; node >= 0; node = nodes[node].parent) {
+            Aabb merged = nodes[nodes[node].left].bounds;
+            merged.extend(nodes[nodes[node].right].bounds);
+            if (merged.min == nodes[node].bounds.min &&
+                merged.max == nodes[node].bounds.max)
+                break;
+            nodes[node].bounds = merged;
+        }
+    }
+
+    // Call visit(item) for every item whose bounds are not fully outside the
+    // frustum. Subtrees entirely inside it are reported without further
+    // tests, and subtrees entirely outside are skipped as a whole.
+    template <typename Visit>
+    void cull(const Frustum &frustum, Visit visit) const {
+        if (rootNode < 0)
+            return;
+        int stack[MaxDepth];
+        int top = 0;
+        stack[top++] = rootNode;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            Frustum::Containment containment = frustum.test(node.bounds);
+            if (containment == Frustum::Containment::Outside)
+                continue;
+            if (containment == Frustum::Containment::Inside) {
+                visitAll(node, visit);
+            } else if (node.item >= 0) {
+                visit(node.item);
+            } else {
+                stack[top++] = node.right;
+                stack[top++] = node.left;
+            }
+        }
+    }
+
+    // Find the closest item hit by a ray, or -1. hit(item, distance) tests
+    // the item itself, and on a hit closer than distance lowers distance to
+    // it and returns true. Only items whose bounds the ray enters before the
+    // closest hit so far are tested. distance is the maximum on input and the
+    // hit distance on output, both in units of direction.
+    template <typename HitTest>
+    int raycast(const QVector3D &origin, const QVector3D &direction,
+                float &distance, HitTest hit) const {
+        if (rootNode < 0)
+            return -1;
+        QVector3D inverse(1.0f / direction.x(), 1.0f / direction.y(),
+                          1.0f / direction.z());
+
+        int closest = -1;
+        int stack[MaxDepth];
+        int top = 0;
+        stack[top++] = rootNode;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            float entry;
+            if (!intersects(node.bounds, origin, inverse, distance, entry))
+                continue;
+            if (node.item >= 0) {
+                if (hit(node.item, distance))
+                    closest = node.item;
+                continue;
+            }
+
+            // Visit the nearer child first so that its hits prune the other
+            float leftEntry, rightEntry;
+            bool left = intersects(nodes[node.left].bounds, origin, inverse,
+                                   distance, leftEntry);
+            bool right = intersects(nodes[node.right].bounds, origin, inverse,
+                                    distance, rightEntry);
+            if (left && right) {
+                bool leftFirst = leftEntry <= rightEntry;
+                stack[top++] = leftFirst ? node.right : node.left;
+                stack[top++] = leftFirst ? node.left : node.right;
+            } else if (left) {
+                stack[top++] = node.left;
+            } else if (right) {
+                stack[top++] = node.right;
+            }
+        }
+        return closest;
+    }
+
+  private:
+    // Median splits keep the depth at about log2(n), far below this
+    static constexpr int MaxDepth = 64;
+
+    struct Node {
+        Aabb bounds;
+        int parent = -1;
+        int left = -1;
+        int right = -1;
+        int item = -1; // Item of a leaf, -1 for inner nodes
+    };
+
+    QVector<Node> nodes;
+    QVector<int> leafOf; // Leaf node of every item
+    int rootNode = -1;
+
+    int buildRange(QVector<int> &items, int begin, int end,
+                   const QVector<Aabb> &bounds,
+                   const QVector<QVector3D> &centroids, int parent) {
+        int index = nodes.size();
+        nodes.append(Node());
+        nodes[index].parent = parent;
+
+        if (end - begin == 1) {
+            int item = items[begin];
+            nodes[index].item = item;
+            nodes[index].bounds = bounds[item];
+            leafOf[item] = index;
+            return index;
+        }
+
+        Aabb centers;
+        for (int i = begin; i < end; ++i) {
+            centers.extend(centroids[items[i]]);
+        }
+        QVector3D extent = centers.extent();
+        int axis = 0;
+        if (extent.y() > extent[axis])
+            axis = 1;
+        if (extent.z() > extent[axis])
+            axis = 2;
+
+        int middle = begin + (end - begin) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + middle,
+                         items.begin() + end, [&](int a, int b) {
+                             return centroids[a][axis] < centroids[b][axis];
+                         });
+
+        int left = buildRange(items, begin, middle, bounds, centroids, index);
+        int right = buildRange(items, middle, end, bounds, centroids, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        nodes[index].bounds = nodes[left].bounds;
+        nodes[index].bounds.extend(nodes[right].bounds);
+        return index;
+    }
+
+    template <typename Visit>
+    void visitAll(const Node &subtree, Visit &visit) const {
+        int stack[MaxDepth];
+        int top = 0;
+        stack[top++] = &subtree - nodes.constData();
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            if (node.item >= 0) {
+                visit(node.item);
+            } else {
+                stack[top++] = node.right;
+                stack[top++] = node.left;
+            }
+        }
+    }
+
+    // Slab test. entry is where the ray enters the box, clamped to 0 for
+    // rays starting inside it.
+    static bool intersects(const Aabb &box, const QVector3D &origin,
+                           const QVector3D &inverse, float maxDistance,
+                           float &entry) {
+        float first = 0, last = maxDistance;
+        for (int axis = 0; axis < 3; ++axis) {
+            float t1 = (box.min[axis] - origin[axis]) * inverse[axis];
+            float t2 = (box.max[axis] - origin[axis]) * inverse[axis];
+            first = std::max(first, std::min(t1, t2));
+            last = std::min(last, std::max(t1, t2));
+        }
+        entry = first;
+        return first <= last;
+    }
+};
+
+#endif // BVH_H
@@ -0,0 +1,72 @@
+#ifndef CAMERACONTROLLER_H
+#define CAMERACONTROLLER_H
+
+#include "qnamespace.h"
+#include "qvectornd.h"
+#include <QSet>
+#include <algorithm>
+
+// CameraController turns held keys into camera motion. Motion is integrated
+// in fixed steps of simulated time, so how far the camera moves only depends
+// on how long a key was held, not on the frame rate or the key repeat rate.
+//
+// W/S move forward and back, A/D left and right; with Shift held they pitch
+// and yaw instead.
+class CameraController {
+  public:
+    static constexpr double Step = 1.0 / 120;  // Simulated seconds per step
+    static constexpr double MaxElapsed = 0.25; // Longer stalls are dropped
+    static constexpr float MoveSpeed = 300;    // Units per second
+    static constexpr float TurnSpeed = 150;    // Degrees per second
+
+    // True for the keys the controller handles
+    static bool isMovementKey(int key) {
+        return key == Qt::Key_W || key == Qt::Key_A || key == Qt::Key_S ||
+               key == Qt::Key_D || key == Qt::Key_Shift;
+    }
+
+    void press(int key) { held.insert(key); }
+
+    void release(int key) { held.remove(key); }
+
+    // Forget all held keys, e.g. when the window is deactivated and will
+    // not see their release
+    void releaseAll() { held.clear(); }
+
+    // Advance simulated time by elapsed seconds of real time and return the
+    // motion of all whole steps in it. Returns false if the camera does not
+    // move.
+    bool advance(double elapsed, QVector3D &translation, float &yaw,
+                 float &pitch) {
+        accumulator += std::min(elapsed, MaxElapsed);
+        int steps = int(accumulator / Step);
+        accumulator -= steps * Step;
+
+        translation = QVector3D(0, 0, 0);
+        yaw = pitch = 0;
+        float forward = axis(Qt::Key_W, Qt::Key_S);
+        float right = axis(Qt::Key_D, Qt::Key_A);
+        if (steps == 0 || (forward == 0 && right == 0))
+            return false;
+
+        float seconds = float(steps * Step);
+        if (held.contains(Qt::Key_Shift)) {
+            yaw = right * TurnSpeed * seconds;
+            pitch = forward * TurnSpeed * seconds;
+        } else {
+            translation = QVector3D(right, 0, forward) * MoveSpeed * seconds;
+        }
+        return true;
+    }
+
+  private:
+    QSet<int> held;         // Keys pressed and not yet released
+    double accumulator = 0; // Simulated time not yet stepped, in seconds
+
+    // 1 if only positive is held, -1 if only negative is, 0 otherwise
+    float axis(int positive, int negative) const {
+        return float(held.contains(positive)) - float(held.contains(negative));
+    }
+};
+
+#endif // CAMERACONTROLLER_H
@@ -0,0 +1,140 @@
+#ifndef CLIPPER_H
+#define CLIPPER_H
+
+#include "qvectornd.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+// Clipper cuts triangles that cannot be rasterized as they are.
+//
+// Input vertices use the ScreenVertices convention: a vertex in front of the
+// near plane is (x, y, w) with x and y in pixels, a vertex on or behind it
+// keeps its homogeneous coordinates (x * w, y * w, w). Clipping happens in
+// homogeneous space, where the near plane and the x/y limits are all linear.
+//
+// Only the near plane is always clipped against. The x and y planes sit on a
+// guard band far outside any viewport; the fill kernels clamp everything
+// inside it to their clip rectangle, so those planes only need clipping when
+// a coordinate would otherwise overflow the kernels' integer and float
+// ranges.
+class Clipper {
+  public:
+    static constexpr float GuardBand = 16384.0f; // Pixels from the origin
+
+    // A plane cuts a convex polygon along one line, so each of the five
+    // passes in clip() adds at most one corner: 3 + 5 = 8
+    static constexpr int MaxVertices = 8;
+
+    // True if the triangle can be drawn without clipping
+    static bool isInside(const QVector3D &p1, const QVector3D &p2,
+                         const QVector3D &p3, float nearPlane) {
+        return isInside(p1, nearPlane) && isInside(p2, nearPlane) &&
+               isInside(p3, nearPlane);
+    }
+
+    // Clip a triangle to the near plane and the guard band. The result is a
+    // convex polygon of screen-space vertices in the input winding, to be
+    // drawn as a fan around the first vertex. Returns the vertex count, 0 if
+    // nothing remains.
+    static int clip(const QVector3D &p1, const QVector3D &p2,
+                    const QVector3D &p3, float nearPlane,
+                    QVector3D out[MaxVertices]) {
+        Vertex buffers[2][MaxVertices];
+        Vertex *polygon = buffers[0];
+        Vertex *scratch = buffers[1];
+        polygon[0] = homogeneous(p1, nearPlane);
+        polygon[1] = homogeneous(p2, nearPlane);
+        polygon[2] = homogeneous(p3, nearPlane);
+        int count = 3;
+
+        for (int plane = NearPlane; plane <= Bottom && count > 0; ++plane) {
+            count = clipPolygon(polygon, count, scratch, (Plane)plane,
+                                nearPlane);
+            std::swap(polygon, scratch);
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const Vertex &v = polygon[i];
+            out[i] = QVector3D(v.x / v.w, v.y / v.w, v.w);
+        }
+        return count;
+    }
+
+  private:
+    enum Plane { NearPlane, Left, Right, Top, Bottom };
+
+    struct Vertex {
+        float x, y, w; // Pixel position times w, and w
+    };
+
+    static bool isInside(const QVector3D &p, float nearPlane) {
+        return p.z() > nearPlane && std::fabs(p.x()) <= GuardBand &&
+               std::fabs(p.y()) <= GuardBand;
+    }
+
+    static Vertex homogeneous(const QVector3D &p, float nearPlane) {
+        if (p.z() > nearPlane)
+            return {p.x() * p.z(), p.y() * p.z(), p.z()};
+        return {p.x(), p.y(), p.z()};
+    }
+
+    // Signed distance to a plane, non-negative on the visible side
+    static float distance(const Vertex &v, Plane plane, float nearPlane) {
+        switch (plane) {
+        case NearPlane:
+            return v.w - nearPlane;
+        case Left:
+            return v.x + GuardBand * v.w;
+        case Right:
+            return GuardBand * v.w - v.x;
+        case Top:
+            return v.y + GuardBand * v.w;
+        case Bottom:
+            return GuardBand * v.w - v.y;
+        }
+        return 0;
+    }
+
+    // One Sutherland-Hodgman pass. Crossing points are always interpolated
+    // from the inside vertex, so triangles sharing an edge get the same
+    // point, and points on the near plane are put exactly on it so the
+    // perspective divide never sees w <= 0.
+    static int clipPolygon(const Vertex *in, int count, Vertex *out,
+                           Plane plane, float nearPlane) {
+        Q_ASSERT(count <= MaxVertices);
+        float d[MaxVertices];
+        bool allInside = true;
+        for (int i = 0; i < count; ++i) {
+            d[i] = distance(in[i], plane, nearPlane);
+            allInside = allInside && d[i] >= 0;
+        }
+        if (allInside) {
+            std::copy(in, in + count, out);
+            return count;
+        }
+
+        int written = 0;
+        for (int i = 0; i < count; ++i) {
+            int j = (i + 1) % count;
+            if (d[i] >= 0)
+                out[written++] = in[i];
+            if ((d[i] >= 0) != (d[j] >= 0)) {
+                int from = d[i] >= 0 ? i : j;
+                int to = d[i] >= 0 ? j : i;
+                float t = d[from] / (d[from] - d[to]);
+                Vertex v;
+                v.x = in[from].x + t * (in[to].x - in[from].x);
+                v.y = in[from].y + t * (in[to].y - in[from].y);
+                v.w = in[from].w + t * (in[to].w - in[from].w);
+                if (plane == NearPlane)
+                    v.w = nearPlane;
+                out[written++] = v;
+            }
+        }
+        Q_ASSERT(written <= count + 1 && written <= MaxVertices);
+        return written;
+    }
+};
+
+#endif // CLIPPER_H
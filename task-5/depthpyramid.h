@@ -0,0 +1,186 @@
+#ifndef DEPTHPYRAMID_H
+#define DEPTHPYRAMID_H
+
+#include "qrect.h"
+#include "rendertarget.h"
+#include <QVector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DEPTHPYRAMID_HAS_SSE_PATH 1
+#else
+#define DEPTHPYRAMID_HAS_SSE_PATH 0
+#endif
+
+// DepthPyramid keeps the largest depth of every 8x8 block of a render target
+// and of every tile above them. A triangle whose nearest depth is at or
+// beyond that maximum cannot pass the depth test anywhere in the block, so
+// the rasterizer can skip the block, or the whole triangle, without walking
+// its pixels.
+//
+// Maxima are refreshed lazily: drawing only marks the blocks it wrote to,
+// and a marked block is rescanned from the depth buffer when it is tested.
+// Every block also keeps the nearest depth drawn into it, a lower bound on
+// all its pixels; a triangle in front of that bound is visible without a
+// rescan, which keeps geometry drawn back to front cheap. Tiles keep both
+// bounds over their blocks for a first test of a whole triangle.
+//
+// Tiles have the tile size of the binner, so that in the tiled mode every
+// worker only touches the blocks of its own tile.
+class DepthPyramid {
+  public:
+    static constexpr int BlockSize = 8; // Pixels per block side
+
+    // Set up the levels for a target and fill them with depth, the value the
+    // depth buffer was cleared to. Buffers keep their capacity.
+    void reset(int width, int height, int tileSize, float depth) {
+        w = std::max(0, width);
+        h = std::max(0, height);
+        blocksPerTile = std::max(1, tileSize / BlockSize);
+        blockColumns = (w + BlockSize - 1) / BlockSize;
+        blockRows = (h + BlockSize - 1) / BlockSize;
+        tileColumns = (blockColumns + blocksPerTile - 1) / blocksPerTile;
+        tileRows = (blockRows + blocksPerTile - 1) / blocksPerTile;
+
+        blockMaximum.fill(depth, blockColumns * blockRows);
+        blockMinimum.fill(depth, blockColumns * blockRows);
+        written.fill(0, blockColumns * blockRows);
+        tileMaximum.fill(depth, tileColumns * tileRows);
+        tileMinimum.fill(depth, tileColumns * tileRows);
+        tileStale.fill(0, tileColumns * tileRows);
+    }
+
+    // True if no pixel of rect can get a depth below depth, judged by the
+    // tile maxima alone. This is the cheap first test for a triangle.
+    bool isTileOccluded(const QRect &rect, float depth) {
+        int tileSide = blocksPerTile * BlockSize;
+        for (int ty = rect.top() / tileSide; ty <= rect.bottom() / tileSide;
+             ++ty) {
+            for (int tx = rect.left() / tileSide;
+                 tx <= rect.right() / tileSide; ++tx) {
+                int tile = ty * tileColumns + tx;
+                if (tileStale[tile])
+                    updateTile(tx, ty);
+                if (depth < tileMaximum[tile])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // True if every pixel of rect is farther than depth, so that a triangle
+    // at depth is visible wherever it covers rect
+    bool isInFront(const QRect &rect, float depth) const {
+        int tileSide = blocksPerTile * BlockSize;
+        for (int ty = rect.top() / tileSide; ty <= rect.bottom() / tileSide;
+             ++ty) {
+            for (int tx = rect.left() / tileSide;
+                 tx <= rect.right() / tileSide; ++tx) {
+                if (depth >= tileMinimum[ty * tileColumns + tx])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // True if no pixel of the block can get a depth below depth
+    bool isBlockOccluded(const RenderTarget &target, int column, int row,
+                         float depth) {
+        int block = row * blockColumns + column;
+        if (depth < blockMinimum[block])
+            return false;
+        if (written[block]) {
+            written[block] = 0;
+            blockMaximum[block] = scanBlock(target, column, row);
+            int tileRow = row / blocksPerTile;
+            tileStale[tileRow * tileColumns + column / blocksPerTile] = 1;
+        }
+        return depth >= blockMaximum[block];
+    }
+
+    // Note that fragments no nearer than depth may have been written inside
+    // rect
+    void markWritten(const QRect &rect, float depth) {
+        for (int by = rect.top() / BlockSize; by <= rect.bottom() / BlockSize;
+             ++by) {
+            int first = by * blockColumns + rect.left() / BlockSize;
+            int last = by * blockColumns + rect.right() / BlockSize;
+            for (int block = first; block <= last; ++block) {
+                written[block] = 1;
+                blockMinimum[block] = std::min(blockMinimum[block], depth);
+            }
+        }
+        int tileSide = blocksPerTile * BlockSize;
+        for (int ty = rect.top() / tileSide; ty <= rect.bottom() / tileSide;
+             ++ty) {
+            for (int tx = rect.left() / tileSide;
+                 tx <= rect.right() / tileSide; ++tx) {
+                float &minimum = tileMinimum[ty * tileColumns + tx];
+                minimum = std::min(minimum, depth);
+            }
+        }
+    }
+
+  private:
+    int w = 0;
+    int h = 0;
+    int blocksPerTile = 1;
+    int blockColumns = 0;
+    int blockRows = 0;
+    int tileColumns = 0;
+    int tileRows = 0;
+    QVector<float> blockMaximum; // Per block as of its last scan, row-major
+    QVector<float> blockMinimum; // Nearest depth drawn into each block
+    QVector<uchar> written;      // Blocks drawn to since their last scan
+    QVector<float> tileMaximum;  // Largest block maximum per tile
+    QVector<float> tileMinimum;  // Nearest depth drawn into each tile
+    QVector<uchar> tileStale;    // Tiles with a block scanned since
+
+    float scanBlock(const RenderTarget &target, int column, int row) const {
+        int x0 = column * BlockSize;
+        int x1 = std::min(w, x0 + BlockSize);
+        int y1 = std::min(h, (row + 1) * BlockSize);
+#if DEPTHPYRAMID_HAS_SSE_PATH
+        // Rows are cache line aligned, so a whole block row is two aligned
+        // vectors
+        if (x1 - x0 == BlockSize) {
+            __m128 maximum = _mm_setzero_ps();
+            for (int y = row * BlockSize; y < y1; ++y) {
+                const float *depthRow = target.depthScanLine(y) + x0;
+                maximum = _mm_max_ps(maximum, _mm_load_ps(depthRow));
+                maximum = _mm_max_ps(maximum, _mm_load_ps(depthRow + 4));
+            }
+            maximum = _mm_max_ps(maximum, _mm_movehl_ps(maximum, maximum));
+            maximum = _mm_max_ps(maximum, _mm_shuffle_ps(maximum, maximum, 1));
+            return _mm_cvtss_f32(maximum);
+        }
+#endif
+        float maximum = 0;
+        for (int y = row * BlockSize; y < y1; ++y) {
+            const float *depthRow = target.depthScanLine(y);
+            for (int x = x0; x < x1; ++x) {
+                maximum = std::max(maximum, depthRow[x]);
+            }
+        }
+        return maximum;
+    }
+
+    void updateTile(int column, int row) {
+        int firstColumn = column * blocksPerTile;
+        int lastColumn = std::min(blockColumns, firstColumn + blocksPerTile);
+        int lastRow = std::min(blockRows, (row + 1) * blocksPerTile);
+        float maximum = 0;
+        for (int by = row * blocksPerTile; by < lastRow; ++by) {
+            const float *blocks = blockMaximum.constData() + by * blockColumns;
+            for (int bx = firstColumn; bx < lastColumn; ++bx) {
+                maximum = std::max(maximum, blocks[bx]);
+            }
+        }
+        int tile = row * tileColumns + column;
+        tileMaximum[tile] = maximum;
+        tileStale[tile] = 0;
+    }
+};
+
+#endif // DEPTHPYRAMID_H
@@ -0,0 +1,217 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include "qrect.h"
+#include "qvectornd.h"
+#include "rendertarget.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Per-pixel stamps for counting overdraw. A covered pixel whose stamp already
+// equals the current stamp was covered twice by the same model, which for a
+// closed mesh drawn with back-face culling means two triangles claimed a
+// pixel of their shared edge.
+struct OverdrawCounter {
+    uint32_t *stamps = nullptr; // One per pixel, same stride as the target
+    uint32_t stamp = 0;         // Stamp of the model being drawn
+    int64_t covered = 0;        // Pixels covered, before the depth test
+    int64_t doubled = 0;        // Pixels covered again by the same stamp
+};
+
+// Fixed-point scanline rasterizer. Vertices are snapped to 28.4 fixed point
+// (1/16 pixel), and coverage follows a strict top-left rule, so triangles
+// that share an edge cover every pixel along it exactly once.
+//
+// Edge functions are exact 64-bit integers, stepped per row; the span of
+// each row is solved from them directly, so pixels inside a span need no
+// edge tests. Depth is a 64-bit fixed-point plane stepped per pixel. The
+// scale of each triangle's depth plane is chosen from its depth range and
+// slope, and the plane coefficients only use correctly rounded operations
+// on exact values, so the result does not depend on the compiler, on FMA
+// contraction or on where the clip rectangle starts.
+//
+// Input is the same as for the other kernels: x and y in pixels, z as view
+// depth. Pixels are sampled at integer coordinates and written when
+// 0 < z < depth.
+class FixedPointRasterizer {
+  public:
+    static constexpr int SubpixelBits = 4;
+    static constexpr int Subpixels = 1 << SubpixelBits;
+
+    static void fillTriangle(RenderTarget &target, const QVector3D &v1,
+                             const QVector3D &v2, const QVector3D &v3,
+                             uint32_t color, const QRect &clip,
+                             OverdrawCounter *overdraw = nullptr) {
+        Setup setup;
+        if (!prepare(target, v1, v2, v3, clip, setup))
+            return;
+        if (overdraw) {
+            fill<true>(target, setup, color, overdraw);
+        } else {
+            fill<false>(target, setup, color, nullptr);
+        }
+    }
+
+  private:
+    struct Setup {
+        int minX, minY, maxX, maxY; // Clipped pixel bounds
+        int originX, originY;       // Unclipped top-left pixel of the bounds
+        int64_t a[3];               // Edge step per pixel in x
+        int64_t b[3];               // Edge step per pixel in y
+        int64_t c[3];               // Edge value at the origin pixel
+        int64_t depth;              // Depth at the origin pixel
+        int64_t depthX, depthY;     // Depth steps per pixel
+        double depthScale;          // Fixed-point depth to view depth
+    };
+
+    static int32_t snap(float v) {
+        return (int32_t)std::lround(v * (float)Subpixels);
+    }
+
+    // Floor of n / d for d > 0
+    static int64_t floorDivide(int64_t n, int64_t d) {
+        int64_t q = n / d;
+        return (n % d != 0 && n < 0) ? q - 1 : q;
+    }
+
+    static bool prepare(const RenderTarget &target, const QVector3D &v1,
+                        const QVector3D &v2, const QVector3D &v3,
+                        const QRect &clip, Setup &s) {
+        if (target.isNull())
+            return false;
+
+        int32_t x[3] = {snap(v1.x()), snap(v2.x()), snap(v3.x())};
+        int32_t y[3] = {snap(v1.y()), snap(v2.y()), snap(v3.y())};
+        double z[3] = {v1.z(), v2.z(), v3.z()};
+
+        int64_t area = int64_t(x[1] - x[0]) * (y[2] - y[0]) -
+                       int64_t(y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0)
+            return false;
+        if (area < 0) {
+            // Make the inside of every edge its non-negative side
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        // Pixels whose sample point lies within the snapped bounds
+        s.originX = (int)floorDivide(
+            std::min({x[0], x[1], x[2]}) + Subpixels - 1, Subpixels);
+        s.originY = (int)floorDivide(
+            std::min({y[0], y[1], y[2]}) + Subpixels - 1, Subpixels);
+        s.minX = std::max(clip.left(), s.originX);
+        s.minY = std::max(clip.top(), s.originY);
+        s.maxX = std::min(
+            clip.right(),
+            (int)floorDivide(std::max({x[0], x[1], x[2]}), Subpixels));
+        s.maxY = std::min(
+            clip.bottom(),
+            (int)floorDivide(std::max({y[0], y[1], y[2]}), Subpixels));
+        if (s.minX > s.maxX || s.minY > s.maxY)
+            return false;
+
+        int64_t originX = int64_t(s.originX) * Subpixels;
+        int64_t originY = int64_t(s.originY) * Subpixels;
+        for (int i = 0; i < 3; ++i) {
+            // Edge opposite to vertex i, from vertex j to vertex k
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            int64_t a = int64_t(y[j]) - y[k];
+            int64_t b = int64_t(x[k]) - x[j];
+            s.a[i] = a * Subpixels;
+            s.b[i] = b * Subpixels;
+            s.c[i] = a * (originX - x[j]) + b * (originY - y[j]);
+
+            // Top-left rule: samples exactly on an edge belong to the
+            // triangle only if the edge is a left edge or a flat top edge
+            bool topLeft = a > 0 || (a == 0 && b > 0);
+            if (!topLeft)
+                s.c[i] -= 1;
+        }
+
+        // Depth gradients per pixel. The float differences and their
+        // products with the integer deltas are exact in double, so only the
+        // final division rounds.
+        double dz1 = z[1] - z[0], dz2 = z[2] - z[0];
+        double gradientX =
+            (dz1 * (y[2] - y[0]) - dz2 * (y[1] - y[0])) * Subpixels / area;
+        double gradientY =
+            (dz2 * (x[1] - x[0]) - dz1 * (x[2] - x[0])) * Subpixels / area;
+
+        // Keep the depth values within 2^38 and the steps within 2^43, so a
+        // whole row of steps cannot overflow
+        double largestDepth =
+            std::max({std::fabs(z[0]), std::fabs(z[1]), std::fabs(z[2])});
+        double steepest = std::max(std::fabs(gradientX), std::fabs(gradientY));
+        int bits = 62;
+        if (largestDepth > 0)
+            bits = std::min(bits, 38 - std::ilogb(largestDepth));
+        if (steepest > 0)
+            bits = std::min(bits, 43 - std::ilogb(steepest));
+
+        s.depthX = std::llround(std::ldexp(gradientX, bits));
+        s.depthY = std::llround(std::ldexp(gradientY, bits));
+        double toOriginX = double(originX - x[0]) / Subpixels;
+        double toOriginY = double(originY - y[0]) / Subpixels;
+        s.depth = std::llround(std::ldexp(z[0], bits)) +
+                  std::llround(std::ldexp(gradientX, bits) * toOriginX) +
+                  std::llround(std::ldexp(gradientY, bits) * toOriginY);
+        s.depthScale = std::ldexp(1.0, -bits);
+        return true;
+    }
+
+    template <bool CountOverdraw>
+    static void fill(RenderTarget &target, const Setup &s, uint32_t color,
+                     OverdrawCounter *overdraw) {
+        int64_t e[3];
+        for (int i = 0; i < 3; ++i) {
+            e[i] = s.c[i] + s.b[i] * (s.minY - s.originY);
+        }
+        int64_t rowDepth = s.depth + s.depthY * (s.minY - s.originY);
+
+        for (int y = s.minY; y <= s.maxY; ++y) {
+            // Solve E_i(x) = e[i] + a[i] * (x - originX) >= 0 for the span
+            int left = s.minX, right = s.maxX;
+            for (int i = 0; i < 3; ++i) {
+                if (s.a[i] > 0) {
+                    int64_t first = floorDivide(-e[i] + s.a[i] - 1, s.a[i]);
+                    left = (int)std::max<int64_t>(left, s.originX + first);
+                } else if (s.a[i] < 0) {
+                    int64_t last = floorDivide(e[i], -s.a[i]);
+                    right = (int)std::min<int64_t>(right, s.originX + last);
+                } else if (e[i] < 0) {
+                    right = left - 1;
+                }
+                e[i] += s.b[i];
+            }
+
+            if (left <= right) {
+                uint32_t *colorRow = target.colorScanLine(y);
+                float *depthRow = target.depthScanLine(y);
+                int64_t depth = rowDepth + s.depthX * (left - s.originX);
+                uint32_t *stamps = nullptr;
+                if (CountOverdraw) {
+                    stamps =
+                        overdraw->stamps + std::size_t(y) * target.stride();
+                    overdraw->covered += right - left + 1;
+                }
+                for (int x = left; x <= right; ++x, depth += s.depthX) {
+                    if (CountOverdraw) {
+                        overdraw->doubled += stamps[x] == overdraw->stamp;
+                        stamps[x] = overdraw->stamp;
+                    }
+                    float z = float(double(depth) * s.depthScale);
+                    if (z > 0.0f && z < depthRow[x]) {
+                        depthRow[x] = z;
+                        colorRow[x] = color;
+                    }
+                }
+            }
+            rowDepth += s.depthY;
+        }
+    }
+};
+
+#endif // FIXEDPOINT_H
@@ -0,0 +1,103 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "bounds.h"
+#include "qmatrix4x4.h"
+#include "qvectornd.h"
+#include <cmath>
+
+// View frustum as world-space planes (a, b, c, d), where a point p is inside
+// a plane when a * p.x + b * p.y + c * p.z + d >= 0. The normals are unit
+// length, so the plane value of a point is its signed distance.
+class Frustum {
+  public:
+    enum Plane { Left, Right, Top, Bottom, Near, PlaneCount };
+
+    enum class Containment {
+        Outside,      // No part of the volume can be visible
+        Intersecting, // Crosses at least one plane
+        Inside        // Entirely visible
+    };
+
+    Frustum() = default;
+
+    // Frustum of a matrix that maps world space to (x * w, y * w, w, w) in
+    // pixels, as VertexStage does. A point is visible when its pixel lies in
+    // [0, width] x [0, height] and its depth w is beyond nearPlane, so the
+    // planes follow from the rows of the matrix directly.
+    static Frustum fromScreenMatrix(const QMatrix4x4 &screen, int width,
+                                    int height, float nearPlane) {
+        QVector4D x = screen.row(0);
+        QVector4D y = screen.row(1);
+        QVector4D w = screen.row(3);
+
+        Frustum frustum;
+        frustum.planes[Left] = x;
+        frustum.planes[Right] = w * width - x;
+        frustum.planes[Top] = y;
+        frustum.planes[Bottom] = w * height - y;
+        frustum.planes[Near] = w - QVector4D(0, 0, 0, nearPlane);
+        for (QVector4D &plane : frustum.planes) {
+            float length = plane.toVector3D().length();
+            if (length > 0)
+                plane /= length;
+        }
+        return frustum;
+    }
+
+    const QVector4D &plane(Plane p) const { return planes[p]; }
+
+    Containment test(const BoundingSphere &sphere) const {
+        if (sphere.isEmpty())
+            return Containment::Outside;
+        Containment result = Containment::Inside;
+        for (const QVector4D &plane : planes) {
+            float distance = distanceTo(plane, sphere.center);
+            if (distance < -sphere.radius)
+                return Containment::Outside;
+            if (distance < sphere.radius)
+                result = Containment::Intersecting;
+        }
+        return result;
+    }
+
+    // For every plane only the box corners farthest along and against its
+    // normal need checking
+    Containment test(const Aabb &box) const {
+        if (box.isEmpty())
+            return Containment::Outside;
+        Containment result = Containment::Inside;
+        for (const QVector4D &plane : planes) {
+            QVector3D farthest(plane.x() >= 0 ? box.max.x() : box.min.x(),
+                               plane.y() >= 0 ? box.max.y() : box.min.y(),
+                               plane.z() >= 0 ? box.max.z() : box.min.z());
+            if (distanceTo(plane, farthest) < 0)
+                return Containment::Outside;
+            QVector3D nearest(plane.x() >= 0 ? box.min.x() : box.max.x(),
+                              plane.y() >= 0 ? box.min.y() : box.max.y(),
+                              plane.z() >= 0 ? box.min.z() : box.max.z());
+            if (distanceTo(plane, nearest) < 0)
+                result = Containment::Intersecting;
+        }
+        return result;
+    }
+
+    // The sphere test is cheaper and settles most cases; the box is only
+    // consulted when the sphere crosses a plane
+    Containment test(const BoundingSphere &sphere, const Aabb &box) const {
+        Containment result = test(sphere);
+        if (result != Containment::Intersecting)
+            return result;
+        return test(box);
+    }
+
+  private:
+    QVector4D planes[PlaneCount];
+
+    static float distanceTo(const QVector4D &plane, const QVector3D &p) {
+        return plane.x() * p.x() + plane.y() * p.y() + plane.z() * p.z() +
+               plane.w();
+    }
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,224 @@
+#ifndef HALFSPACE_H
+#define HALFSPACE_H
+
+#include "qrect.h"
+#include "qvectornd.h"
+#include "rendertarget.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HALFSPACE_HAS_AVX2_PATH 1
+#else
+#define HALFSPACE_HAS_AVX2_PATH 0
+#endif
+
+// Half-space (edge function) triangle rasterizer. Each of the three edges is
+// a linear function E(x, y) = A * x + B * y + C that is non-negative on the
+// inside of the triangle, and depth is a plane over the same bounding box, so
+// every pixel only costs a multiply-add per equation. The AVX2 path evaluates
+// 8 pixels of a row per step; the scalar path is used on CPUs without AVX2.
+//
+// Equations are evaluated from integer pixel offsets that are stepped per
+// row and per block, never from accumulated float sums. A pixel therefore
+// gets the same result no matter where the clip rectangle starts, and tiled
+// rendering matches serial rendering bit for bit.
+//
+// The kernel takes the same screen-space input as
+// Renderer::fillTriangleScanLine: x and y in pixels, z as view depth. Pixels
+// are sampled at integer coordinates, both windings are accepted, and a pixel
+// is written when 0 < z < depth.
+class HalfSpaceRasterizer {
+  public:
+    static void fillTriangle(RenderTarget &target, const QVector3D &v1,
+                             const QVector3D &v2, const QVector3D &v3,
+                             uint32_t color, const QRect &clip) {
+        Setup setup;
+        if (!prepare(target, v1, v2, v3, clip, setup))
+            return;
+#if HALFSPACE_HAS_AVX2_PATH
+        if (hasAvx2()) {
+            fillAvx2(target, setup, color);
+            return;
+        }
+#endif
+        fillScalar(target, setup, color);
+    }
+
+    // Force the portable path, e.g. to compare it against the AVX2 one
+    static void fillTriangleScalar(RenderTarget &target, const QVector3D &v1,
+                                   const QVector3D &v2, const QVector3D &v3,
+                                   uint32_t color, const QRect &clip) {
+        Setup setup;
+        if (prepare(target, v1, v2, v3, clip, setup))
+            fillScalar(target, setup, color);
+    }
+
+    static bool hasAvx2() {
+#if HALFSPACE_HAS_AVX2_PATH
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+  private:
+    // Edge and depth equations for one triangle. Coordinates are taken
+    // relative to the top-left corner (originX, originY) of the unclipped
+    // bounding box to keep the magnitudes, and so the rounding error, small.
+    struct Setup {
+        int minX, minY, maxX, maxY; // Clipped pixel bounds
+        int originX, originY;
+        float a[3], b[3], c[3]; // E_i(x, y) = a[i] * x + b[i] * y + c[i]
+        float za, zb, zc;       // z(x, y) = za * x + zb * y + zc
+    };
+
+    static bool prepare(const RenderTarget &target, const QVector3D &v1,
+                        QVector3D v2, QVector3D v3, const QRect &clip,
+                        Setup &s) {
+        if (target.isNull())
+            return false;
+
+        s.originX = (int)std::ceil(std::min({v1.x(), v2.x(), v3.x()}));
+        s.originY = (int)std::ceil(std::min({v1.y(), v2.y(), v3.y()}));
+        s.minX = std::max(clip.left(), s.originX);
+        s.maxX = std::min(clip.right(),
+                          (int)std::floor(std::max({v1.x(), v2.x(), v3.x()})));
+        s.minY = std::max(clip.top(), s.originY);
+        s.maxY = std::min(clip.bottom(),
+                          (int)std::floor(std::max({v1.y(), v2.y(), v3.y()})));
+        if (s.minX > s.maxX || s.minY > s.maxY)
+            return false;
+
+        // Make the winding counter-clockwise in screen space so the inside of
+        // every edge is its non-negative side
+        double area = (double(v2.x()) - v1.x()) * (double(v3.y()) - v1.y()) -
+                      (double(v2.y()) - v1.y()) * (double(v3.x()) - v1.x());
+        if (area == 0.0)
+            return false;
+        if (area < 0.0) {
+            std::swap(v2, v3);
+            area = -area;
+        }
+
+        const QVector3D *v[3] = {&v1, &v2, &v3};
+        double ox = s.originX, oy = s.originY;
+        double za = 0, zb = 0, zc = 0;
+        for (int i = 0; i < 3; ++i) {
+            // Edge opposite to vertex i, from v[i + 1] to v[i + 2]
+            const QVector3D &p = *v[(i + 1) % 3];
+            const QVector3D &q = *v[(i + 2) % 3];
+            double a = double(p.y()) - q.y();
+            double b = double(q.x()) - p.x();
+            double c = -(a * (p.x() - ox) + b * (p.y() - oy));
+            s.a[i] = float(a);
+            s.b[i] = float(b);
+            s.c[i] = float(c);
+
+            // The normalized edge function is the barycentric weight of
+            // vertex i, so depth is their z-weighted sum
+            double z = v[i]->z() / area;
+            za += a * z;
+            zb += b * z;
+            zc += c * z;
+        }
+        s.za = float(za);
+        s.zb = float(zb);
+        s.zc = float(zc);
+        return true;
+    }
+
+    static void fillScalar(RenderTarget &target, const Setup &s,
+                           uint32_t color) {
+        for (int y = s.minY; y <= s.maxY; ++y) {
+            uint32_t *colorRow = target.colorScanLine(y);
+            float *depthRow = target.depthScanLine(y);
+
+            float dy = float(y - s.originY);
+            float e0Row = s.b[0] * dy + s.c[0];
+            float e1Row = s.b[1] * dy + s.c[1];
+            float e2Row = s.b[2] * dy + s.c[2];
+            float zRow = s.zb * dy + s.zc;
+
+            float dx = float(s.minX - s.originX);
+            for (int x = s.minX; x <= s.maxX; ++x, dx += 1.0f) {
+                float e0 = e0Row + s.a[0] * dx;
+                float e1 = e1Row + s.a[1] * dx;
+                float e2 = e2Row + s.a[2] * dx;
+                float z = zRow + s.za * dx;
+                if (e0 >= 0 && e1 >= 0 && e2 >= 0 && z > 0.0f &&
+                    z < depthRow[x]) {
+                    depthRow[x] = z;
+                    colorRow[x] = color;
+                }
+            }
+        }
+    }
+
+#if HALFSPACE_HAS_AVX2_PATH
+    __attribute__((target("avx2"))) static void
+    fillAvx2(RenderTarget &target, const Setup &s, uint32_t color) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 eight = _mm256_set1_ps(8.0f);
+        const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i colorValue = _mm256_set1_epi32((int)color);
+
+        const __m256 a0 = _mm256_set1_ps(s.a[0]);
+        const __m256 a1 = _mm256_set1_ps(s.a[1]);
+        const __m256 a2 = _mm256_set1_ps(s.a[2]);
+        const __m256 za = _mm256_set1_ps(s.za);
+
+        // Offsets of the first block's lanes from the triangle origin
+        const __m256 firstDx =
+            _mm256_add_ps(_mm256_set1_ps(float(s.minX - s.originX)),
+                          _mm256_cvtepi32_ps(laneIndex));
+
+        const int span = s.maxX - s.minX + 1;
+        for (int y = s.minY; y <= s.maxY; ++y) {
+            uint32_t *colorRow = target.colorScanLine(y) + s.minX;
+            float *depthRow = target.depthScanLine(y) + s.minX;
+
+            float dy = float(y - s.originY);
+            __m256 e0Row = _mm256_set1_ps(s.b[0] * dy + s.c[0]);
+            __m256 e1Row = _mm256_set1_ps(s.b[1] * dy + s.c[1]);
+            __m256 e2Row = _mm256_set1_ps(s.b[2] * dy + s.c[2]);
+            __m256 zRow = _mm256_set1_ps(s.zb * dy + s.zc);
+
+            __m256 dx = firstDx;
+            for (int x = 0; x < span; x += 8, dx = _mm256_add_ps(dx, eight)) {
+                __m256 e0 = _mm256_add_ps(e0Row, _mm256_mul_ps(a0, dx));
+                __m256 e1 = _mm256_add_ps(e1Row, _mm256_mul_ps(a1, dx));
+                __m256 e2 = _mm256_add_ps(e2Row, _mm256_mul_ps(a2, dx));
+                __m256 z = _mm256_add_ps(zRow, _mm256_mul_ps(za, dx));
+
+                // Lanes past the end of the span must not touch memory; masked
+                // loads and stores never access disabled lanes
+                __m256i valid =
+                    _mm256_cmpgt_epi32(_mm256_set1_epi32(span - x), laneIndex);
+                __m256 inside = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                                  _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(e2, zero, _CMP_GE_OQ),
+                                  _mm256_cmp_ps(z, zero, _CMP_GT_OQ)));
+                inside = _mm256_and_ps(inside, _mm256_castsi256_ps(valid));
+                if (_mm256_testz_ps(inside, inside))
+                    continue;
+
+                __m256 depth = _mm256_maskload_ps(depthRow + x,
+                                                  _mm256_castps_si256(inside));
+                __m256i pass = _mm256_castps_si256(_mm256_and_ps(
+                    inside, _mm256_cmp_ps(z, depth, _CMP_LT_OQ)));
+                _mm256_maskstore_ps(depthRow + x, pass, z);
+                _mm256_maskstore_epi32(reinterpret_cast<int *>(colorRow + x),
+                                       pass, colorValue);
+            }
+        }
+    }
+#endif
+};
+
+#endif // HALFSPACE_H
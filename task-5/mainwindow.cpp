@@ -1,7 +1,10 @@
 #include "mainwindow.h"
+#include "profiler.h"
 #include "rasterizer.h"
 #include "scene.h"
 #include "ui_mainwindow.h"
+#include <QDir>
+#include <QScreen>
 #include <QVBoxLayout> // For layout
 
 MainWindow::MainWindow(QWidget *parent)
@@ -11,16 +14,30 @@ MainWindow::MainWindow(QWidget *parent)
     // Set up status bar
     mousePositionLabel = new QLabel("Mouse: (0, 0)");
     statusBar()->addWidget(mousePositionLabel);
+    hoveredModelLabel = new QLabel("Model: none");
+    statusBar()->addWidget(hoveredModelLabel);
+    frameStatsLabel = new QLabel();
+    statusBar()->addPermanentWidget(frameStatsLabel);
+    profileLabel = new QLabel();
+    profileLabel->setVisible(false);
+    statusBar()->addPermanentWidget(profileLabel);
+    Profiler::setThreadName("gui");
 
     // Scene setup
     Scene *scene = new Scene();
     scene->readFromObjFile(
         ":/assets/models/cube.obj"); // Load cube model from OBJ file
-    scene->readFromObjFile(":/assets/models/cube2.obj");
-    QImage *targetImage =
-        new QImage(this->width(), this->height(), QImage::Format_ARGB32);
-    rasterizer = new Rasterizer(targetImage, scene);
-    rasterizer->renderScene();
+    // Second cube: the same mesh, moved left and forward
+    QMatrix4x4 secondCube;
+    secondCube.translate(-30, 0, 200);
+    scene->addInstance(0, secondCube);
+    for (int i = 0; i < scene->getModels().size(); ++i) {
+        scene->setOccluder(i, true); // Closed and only 12 triangles each
+    }
+    rasterizer = new Rasterizer(scene, this->width(), this->height());
+    connect(rasterizer, &Rasterizer::frameRendered, this,
+            &MainWindow::updateFrameStats);
+    rasterizer->requestFrame();
 
     // Set size policies to make rasterizer expand to fill all available space
     rasterizer->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
@@ -29,10 +46,26 @@ MainWindow::MainWindow(QWidget *parent)
     // Connect mouse position signal
     connect(rasterizer, &Rasterizer::mousePositionChanged, this,
             &MainWindow::updateMousePosition);
+    connect(rasterizer, &Rasterizer::hoveredModelChanged, this,
+            &MainWindow::updateHoveredModel);
 
     // Set the rasterizer directly as the central widget to eliminate all
     // margins
     setCentralWidget(rasterizer);
+
+    // Frame loop: once per display interval, move the camera by the keys
+    // held since the last tick and ask for a frame. Frames that would start
+    // while the previous one is still being drawn are skipped.
+    qreal refreshRate = 60;
+    if (QScreen *screen = QGuiApplication::primaryScreen())
+        refreshRate = std::max<qreal>(screen->refreshRate(), 1);
+    frameTimer = new QTimer(this);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    frameTimer->setInterval(qRound(1000 / refreshRate));
+    connect(frameTimer, &QTimer::timeout, this, &MainWindow::advanceFrame);
+    frameClock.start();
+    fpsClock.start();
+    frameTimer->start();
 }
 
 MainWindow::~MainWindow() {
@@ -42,53 +75,197 @@ MainWindow::~MainWindow() {
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
-    const int step = 10;             // Step size for camera movement
-    const float rotationStep = 5.0f; // Rotation step in degrees
-
-    bool shiftPressed = event->modifiers() & Qt::ShiftModifier;
+    // Movement keys only move the camera while held, see advanceFrame
+    if (CameraController::isMovementKey(event->key())) {
+        if (!event->isAutoRepeat())
+            cameraController.press(event->key());
+        return;
+    }
+    if (event->isAutoRepeat())
+        return;
 
     switch (event->key()) {
-    case Qt::Key_W:
-        if (shiftPressed) {
-            // Rotate camera up (pitch up)
-            rasterizer->RotateCamera(0, rotationStep);
-        } else {
-            // Move camera forward
-            rasterizer->TranslateCamera(QVector3D(0, 0, step));
-        }
+    case Qt::Key_M: {
+        // Toggle between the serial and the tiled render path
+        bool tiled =
+            rasterizer->getRenderMode() == Rasterizer::RenderMode::Tiled;
+        rasterizer->setRenderMode(tiled ? Rasterizer::RenderMode::Serial
+                                        : Rasterizer::RenderMode::Tiled);
+        statusBar()->showMessage(tiled ? "Render mode: serial"
+                                       : "Render mode: tiled",
+                                 2000);
         break;
-    case Qt::Key_S:
-        if (shiftPressed) {
-            // Rotate camera down (pitch down)
-            rasterizer->RotateCamera(0, -rotationStep);
+    }
+    case Qt::Key_K: {
+        // Cycle the fill kernel: fixed-point, scanline, half-space
+        Rasterizer::FillKernel kernel = rasterizer->getFillKernel();
+        if (kernel == Rasterizer::FillKernel::FixedPoint) {
+            rasterizer->setFillKernel(Rasterizer::FillKernel::ScanLine);
+            statusBar()->showMessage("Fill kernel: scanline", 2000);
+        } else if (kernel == Rasterizer::FillKernel::ScanLine) {
+            rasterizer->setFillKernel(Rasterizer::FillKernel::HalfSpace);
+            statusBar()->showMessage("Fill kernel: half-space", 2000);
         } else {
-            // Move camera backward
-            rasterizer->TranslateCamera(QVector3D(0, 0, -step));
+            rasterizer->setFillKernel(Rasterizer::FillKernel::FixedPoint);
+            statusBar()->showMessage("Fill kernel: fixed-point", 2000);
         }
         break;
-    case Qt::Key_A:
-        if (shiftPressed) {
-            // Rotate camera left (yaw left)
-            rasterizer->RotateCamera(-rotationStep, 0);
-        } else {
-            // Move camera left
-            rasterizer->TranslateCamera(QVector3D(-step, 0, 0));
-        }
+    }
+    case Qt::Key_V: {
+        // Toggle counting of pixels a model covers more than once
+        bool counting = !rasterizer->isOverdrawCountingEnabled();
+        rasterizer->setOverdrawCounting(counting);
+        statusBar()->showMessage(counting ? "Overdraw counting: on"
+                                          : "Overdraw counting: off",
+                                 2000);
+        break;
+    }
+    case Qt::Key_C: {
+        // Toggle view frustum culling of whole models
+        bool culling = !rasterizer->isFrustumCullingEnabled();
+        rasterizer->setFrustumCulling(culling);
+        statusBar()->showMessage(culling ? "Frustum culling: on"
+                                         : "Frustum culling: off",
+                                 2000);
+        break;
+    }
+    case Qt::Key_O: {
+        // Toggle occlusion culling of whole models
+        bool culling = !rasterizer->isOcclusionCullingEnabled();
+        rasterizer->setOcclusionCulling(culling);
+        statusBar()->showMessage(culling ? "Occlusion culling: on"
+                                         : "Occlusion culling: off",
+                                 2000);
+        break;
+    }
+    case Qt::Key_Z: {
+        // Toggle early rejection of hidden triangles by hierarchical Z
+        bool enabled = !rasterizer->isHierarchicalZEnabled();
+        rasterizer->setHierarchicalZ(enabled);
+        statusBar()->showMessage(enabled ? "Hierarchical Z: on"
+                                         : "Hierarchical Z: off",
+                                 2000);
+        break;
+    }
+    case Qt::Key_P: {
+        // Toggle timing of the pipeline stages
+        bool profiling = !Profiler::isEnabled();
+        Profiler::setEnabled(profiling);
+        profileWindowStart = Profiler::now();
+        profileLabel->setVisible(profiling);
+        profileLabel->setText("Profiling...");
+        statusBar()->showMessage(profiling ? "Profiling: on"
+                                           : "Profiling: off",
+                                 2000);
+        break;
+    }
+    case Qt::Key_T: {
+        // Save the recorded stage timings for chrome://tracing or Perfetto
+        QString path = QDir::current().absoluteFilePath("frame-trace.json");
+        statusBar()->showMessage(Profiler::writeChromeTrace(path)
+                                     ? "Trace written to " + path
+                                     : "Could not write " + path,
+                                 4000);
         break;
-    case Qt::Key_D:
-        if (shiftPressed) {
-            // Rotate camera right (yaw right)
-            rasterizer->RotateCamera(rotationStep, 0);
+    }
+    case Qt::Key_B: {
+        // Cycle the face culling mode: back, front, none
+        Rasterizer::CullMode mode = rasterizer->getCullMode();
+        if (mode == Rasterizer::CullMode::Back) {
+            rasterizer->setCullMode(Rasterizer::CullMode::Front);
+            statusBar()->showMessage("Face culling: front", 2000);
+        } else if (mode == Rasterizer::CullMode::Front) {
+            rasterizer->setCullMode(Rasterizer::CullMode::None);
+            statusBar()->showMessage("Face culling: none", 2000);
         } else {
-            // Move camera right
-            rasterizer->TranslateCamera(QVector3D(step, 0, 0));
+            rasterizer->setCullMode(Rasterizer::CullMode::Back);
+            statusBar()->showMessage("Face culling: back", 2000);
         }
         break;
+    }
     default:
         QMainWindow::keyPressEvent(event);
     }
 }
 
+void MainWindow::keyReleaseEvent(QKeyEvent *event) {
+    if (!event->isAutoRepeat() &&
+        CameraController::isMovementKey(event->key())) {
+        cameraController.release(event->key());
+        return;
+    }
+    QMainWindow::keyReleaseEvent(event);
+}
+
+void MainWindow::advanceFrame() {
+    double elapsed = frameClock.nsecsElapsed() * 1e-9;
+    frameClock.restart();
+
+    // Key releases are not delivered to inactive windows
+    if (!isActiveWindow())
+        cameraController.releaseAll();
+
+    QVector3D translation;
+    float yaw, pitch;
+    if (cameraController.advance(elapsed, translation, yaw, pitch))
+        rasterizer->MoveCamera(translation, yaw, pitch);
+}
+
 void MainWindow::updateMousePosition(int x, int y) {
     mousePositionLabel->setText(QString("Mouse: (%1, %2)").arg(x).arg(y));
+}
+
+void MainWindow::updateFrameStats(const Rasterizer::FrameStats &stats) {
+    // Frames shown per second, over about a second
+    framesShown++;
+    if (fpsClock.elapsed() >= 1000) {
+        framesPerSecond = framesShown * 1000.0 / fpsClock.restart();
+        framesShown = 0;
+        if (Profiler::isEnabled())
+            updateProfile(Profiler::now());
+    }
+
+    frameStatsLabel->setText(
+        QString("%1 fps | Models: %2 drawn, %3 culled, %4 occluded | "
+                "Triangles: %5 culled, %6 occluded | Fragments: %7 skipped")
+            .arg(framesPerSecond, 0, 'f', 1)
+            .arg(stats.modelsDrawn)
+            .arg(stats.modelsCulled)
+            .arg(stats.modelsOccluded)
+            .arg(stats.trianglesCulled)
+            .arg(stats.trianglesOccluded)
+            .arg(stats.fragmentsSkipped) +
+        (rasterizer->isOverdrawCountingEnabled()
+             ? QString(", %1 covered, %2 double writes")
+                   .arg(stats.fragmentsCovered)
+                   .arg(stats.doubleWrites)
+             : QString()));
+}
+
+// Show the mean time of each stage per rendered frame since the last update.
+// Raster times of the tiled mode are summed over the worker threads.
+void MainWindow::updateProfile(qint64 windowEnd) {
+    QVector<Profiler::StageTime> stages =
+        Profiler::summarize(profileWindowStart, windowEnd);
+    profileWindowStart = windowEnd;
+
+    int frames = 0;
+    for (const Profiler::StageTime &stage : stages) {
+        if (qstrcmp(stage.name, Profiler::Frame) == 0)
+            frames = stage.count;
+    }
+    if (frames == 0)
+        return;
+    QStringList parts;
+    for (const Profiler::StageTime &stage : stages) {
+        parts.append(QString("%1 %2")
+                         .arg(stage.name)
+                         .arg(stage.nanoseconds / 1e6 / frames, 0, 'f', 2));
+    }
+    profileLabel->setText(parts.join(" | ") + " ms");
+}
+
+void MainWindow::updateHoveredModel(int index) {
+    hoveredModelLabel->setText(index < 0 ? QString("Model: none")
+                                         : QString("Model: %1").arg(index));
 }
\ No newline at end of file
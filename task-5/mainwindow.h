@@ -1,10 +1,13 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "cameracontroller.h"
 #include "rasterizer.h"
+#include <QElapsedTimer>
 #include <QMainWindow>
 #include <QStatusBar>
 #include <QLabel>
+#include <QTimer>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -21,13 +24,31 @@ public:
     ~MainWindow();
 protected:
     void keyPressEvent(QKeyEvent *event) override;
+    void keyReleaseEvent(QKeyEvent *event) override;
 
 public slots:
     void updateMousePosition(int x, int y);
+    void updateFrameStats(const Rasterizer::FrameStats &stats);
+    void updateHoveredModel(int index);
+
+private slots:
+    void advanceFrame();
 
 private:
     Ui::MainWindow *ui;
     QLabel *mousePositionLabel;
+    QLabel *frameStatsLabel;
+    QLabel *hoveredModelLabel;
+    QLabel *profileLabel; // Stage times, shown while profiling
     Rasterizer *rasterizer; 
+    CameraController cameraController; // Held movement keys
+    QTimer *frameTimer;                // Ticks once per display interval
+    QElapsedTimer frameClock;          // Time since the last tick
+    QElapsedTimer fpsClock;            // Time since fps was last updated
+    int framesShown = 0;               // Frames since fps was last updated
+    double framesPerSecond = 0;
+    qint64 profileWindowStart = 0; // Profiler::now() of the last fps update
+
+    void updateProfile(qint64 windowEnd);
 };
 #endif // MAINWINDOW_H
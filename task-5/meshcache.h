@@ -0,0 +1,277 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "meshdata.h"
+#include "qdebug.h"
+#include "qfile.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+#include <memory>
+
+// MeshCache stores meshes parsed from OBJ files in a binary file next to the
+// application cache, so later runs can skip parsing altogether.
+//
+// A cache file is a fixed header followed by the vertex, index and triangle
+// color buffers, each starting on a 64 byte boundary. Loading maps the whole
+// file and hands views into the mapped pages to MeshData, so no vertex is
+// copied; the cost of a load is one pass over the indices to check that they
+// stay within the vertex buffer, and the page faults of the first frame that
+// touches the vertices.
+//
+// The header records the size, modification time and a checksum of the OBJ it
+// was built from. A matching size and time is trusted as is, otherwise the
+// source is hashed and compared before the cache is used. Files are written
+// in native byte order and rejected on a machine with a different one.
+class MeshCache {
+  public:
+    static constexpr quint32 Version = 4;
+
+    // Cached mesh for the OBJ at sourcePath, or null if there is no valid
+    // cache for the current contents of the file
+    static std::shared_ptr<const MeshData> load(const QString &sourcePath) {
+        std::unique_ptr<QFile> file(new QFile(cachePath(sourcePath)));
+        if (!file->exists() || !file->open(QIODevice::ReadOnly))
+            return nullptr;
+
+        qint64 size = file->size();
+        if (size < (qint64)sizeof(Header))
+            return rejected(sourcePath, "truncated header");
+
+        const uchar *mapped = file->map(0, size);
+        if (!mapped)
+            return rejected(sourcePath, "file could not be mapped");
+
+        Header header;
+        std::memcpy(&header, mapped, sizeof(Header));
+        if (!isValid(header, size))
+            return rejected(sourcePath, "unknown format or version");
+        if (!matchesSource(header, sourcePath))
+            return rejected(sourcePath, "source file changed");
+
+        ArrayView<QVector3D> vertices(
+            reinterpret_cast<const QVector3D *>(mapped + header.vertexOffset),
+            header.vertexCount);
+        ArrayView<quint32> indices(
+            reinterpret_cast<const quint32 *>(mapped + header.indexOffset),
+            header.indexCount);
+        ArrayView<quint32> colors(
+            reinterpret_cast<const quint32 *>(mapped + header.colorOffset),
+            header.indexCount / 3);
+        for (quint32 index : indices) {
+            if (index >= header.vertexCount)
+                return rejected(sourcePath, "index out of range");
+        }
+        Aabb bounds;
+        bounds.min = QVector3D(header.boundsMin[0], header.boundsMin[1],
+                               header.boundsMin[2]);
+        bounds.max = QVector3D(header.boundsMax[0], header.boundsMax[1],
+                               header.boundsMax[2]);
+        BoundingSphere sphere;
+        sphere.center = QVector3D(header.sphere[0], header.sphere[1],
+                                  header.sphere[2]);
+        sphere.radius = header.sphere[3];
+        return MeshData::fromMapping(std::move(file), vertices, indices,
+                                     colors, bounds, sphere,
+                                     (MeshWinding)header.winding);
+    }
+
+    // Write the cache for the OBJ at sourcePath. The file is replaced
+    // atomically, so a reader never sees a partially written cache.
+    static bool store(const QString &sourcePath, const MeshData &mesh) {
+        QString path = cachePath(sourcePath);
+        if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+            qWarning() << "Could not create mesh cache directory for" << path;
+            return false;
+        }
+
+        QFileInfo source(sourcePath);
+        Header header;
+        header.sourceSize = source.size();
+        header.sourceModified = modificationTime(source);
+        if (!checksumFile(sourcePath, header.sourceChecksum))
+            return false;
+
+        ArrayView<QVector3D> vertices = mesh.vertices();
+        ArrayView<quint32> indices = mesh.indices();
+        ArrayView<quint32> colors = mesh.colors();
+        qint64 vertexBytes = (qint64)vertices.size() * sizeof(QVector3D);
+        qint64 indexBytes = (qint64)indices.size() * sizeof(quint32);
+        qint64 colorBytes = (qint64)colors.size() * sizeof(quint32);
+        header.vertexCount = vertices.size();
+        header.indexCount = indices.size();
+        header.vertexOffset = align(sizeof(Header));
+        header.indexOffset = align(header.vertexOffset + vertexBytes);
+        header.colorOffset = align(header.indexOffset + indexBytes);
+        const Aabb &bounds = mesh.bounds();
+        for (int i = 0; i < 3; ++i) {
+            header.boundsMin[i] = bounds.min[i];
+            header.boundsMax[i] = bounds.max[i];
+            header.sphere[i] = mesh.boundingSphere().center[i];
+        }
+        header.sphere[3] = mesh.boundingSphere().radius;
+        header.winding = (quint32)mesh.winding();
+
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Could not write mesh cache:" << path;
+            return false;
+        }
+        const char padding[Alignment] = {};
+        qint64 written = 0;
+        auto write = [&](const void *data, qint64 bytes, qint64 offset) {
+            file.write(padding, offset - written);
+            file.write(static_cast<const char *>(data), bytes);
+            written = offset + bytes;
+        };
+        write(&header, sizeof(Header), 0);
+        write(vertices.data(), vertexBytes, header.vertexOffset);
+        write(indices.data(), indexBytes, header.indexOffset);
+        write(colors.data(), colorBytes, header.colorOffset);
+        if (!file.commit()) {
+            qWarning() << "Could not write mesh cache:" << path;
+            return false;
+        }
+        return true;
+    }
+
+    // Cache file used for the OBJ at sourcePath. The name keeps the OBJ base
+    // name for readability and a hash of its absolute path for uniqueness.
+    static QString cachePath(const QString &sourcePath) {
+        QFileInfo source(sourcePath);
+        QByteArray key = source.absoluteFilePath().toUtf8();
+        QString name = source.completeBaseName() + "-" +
+                       QString::number(checksum(key.constData(), key.size()),
+                                       16) +
+                       ".cgmesh";
+        QString directory =
+            QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        return QDir(directory).filePath("meshes/" + name);
+    }
+
+    // 64-bit FNV-1a over 8 byte words, fast enough to hash large OBJ files
+    // without showing up next to the cost of parsing them
+    static quint64 checksum(const char *data, qint64 size) {
+        const quint64 prime = 0x100000001b3ull;
+        quint64 hash = 0xcbf29ce484222325ull;
+        qint64 i = 0;
+        for (; i + 8 <= size; i += 8) {
+            quint64 word;
+            std::memcpy(&word, data + i, 8);
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; ++i) {
+            hash = (hash ^ (uchar)data[i]) * prime;
+        }
+        return hash ^ (quint64)size;
+    }
+
+  private:
+    static constexpr qint64 Alignment = 64;
+    static constexpr quint32 ByteOrderMark = 0x01020304;
+
+    static_assert(sizeof(QVector3D) == 3 * sizeof(float),
+                  "QVector3D must be three packed floats to be mapped");
+
+    struct Header {
+        char magic[8] = {'C', 'G', 'M', 'E', 'S', 'H', '\0', '\0'};
+        quint32 version = Version;
+        quint32 byteOrder = ByteOrderMark;
+        quint32 headerSize = sizeof(Header);
+        quint32 vertexCount = 0;
+        quint32 indexCount = 0;
+        quint32 winding = 0; // MeshWinding
+        quint64 vertexOffset = 0;
+        quint64 indexOffset = 0;
+        quint64 colorOffset = 0; // indexCount / 3 colors
+        qint64 sourceSize = 0;
+        qint64 sourceModified = 0; // Milliseconds since epoch, 0 if unknown
+        quint64 sourceChecksum = 0;
+        float boundsMin[3] = {0, 0, 0};
+        float boundsMax[3] = {0, 0, 0};
+        float sphere[4] = {0, 0, 0, -1}; // Center and radius
+    };
+
+    static quint64 align(quint64 offset) {
+        return (offset + Alignment - 1) / Alignment * Alignment;
+    }
+
+    // True if bytes starting at offset lie within a file of fileSize bytes.
+    // Compared without adding, so a huge offset cannot wrap around.
+    static bool fits(quint64 offset, quint64 bytes, quint64 fileSize) {
+        return bytes <= fileSize && offset <= fileSize - bytes;
+    }
+
+    static bool isValid(const Header &header, qint64 fileSize) {
+        Header expected;
+        // Counts are 32-bit, so their byte sizes cannot overflow
+        quint64 vertexBytes = (quint64)header.vertexCount * sizeof(QVector3D);
+        quint64 indexBytes = (quint64)header.indexCount * sizeof(quint32);
+        quint64 colorBytes = (quint64)header.indexCount / 3 * sizeof(quint32);
+        if (!fits(header.vertexOffset, vertexBytes, fileSize) ||
+            !fits(header.indexOffset, indexBytes, fileSize) ||
+            !fits(header.colorOffset, colorBytes, fileSize))
+            return false;
+        quint64 vertexEnd = header.vertexOffset + vertexBytes;
+        quint64 indexEnd = header.indexOffset + indexBytes;
+        return std::memcmp(header.magic, expected.magic, 8) == 0 &&
+               header.version == Version &&
+               header.byteOrder == ByteOrderMark &&
+               header.headerSize == sizeof(Header) &&
+               header.indexCount % 3 == 0 &&
+               header.winding <= (quint32)MeshWinding::Outward &&
+               header.vertexOffset % Alignment == 0 &&
+               header.indexOffset % Alignment == 0 &&
+               header.vertexOffset >= sizeof(Header) &&
+               header.colorOffset % Alignment == 0 &&
+               header.indexOffset >= vertexEnd &&
+               header.colorOffset >= indexEnd;
+    }
+
+    static qint64 modificationTime(const QFileInfo &source) {
+        QDateTime modified = source.lastModified();
+        return modified.isValid() ? modified.toMSecsSinceEpoch() : 0;
+    }
+
+    static bool matchesSource(const Header &header, const QString &sourcePath) {
+        QFileInfo source(sourcePath);
+        if (!source.exists() || source.size() != header.sourceSize)
+            return false;
+
+        qint64 modified = modificationTime(source);
+        if (modified != 0 && modified == header.sourceModified)
+            return true;
+
+        // Touched, copied or without a timestamp: compare the contents
+        quint64 sum = 0;
+        return checksumFile(sourcePath, sum) && sum == header.sourceChecksum;
+    }
+
+    static bool checksumFile(const QString &filePath, quint64 &sum) {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        qint64 size = file.size();
+        const uchar *mapped = size > 0 ? file.map(0, size) : nullptr;
+        if (mapped) {
+            sum = checksum(reinterpret_cast<const char *>(mapped), size);
+            file.unmap(const_cast<uchar *>(mapped));
+        } else {
+            QByteArray data = file.readAll();
+            sum = checksum(data.constData(), data.size());
+        }
+        return true;
+    }
+
+    static std::shared_ptr<const MeshData> rejected(const QString &sourcePath,
+                                                    const char *reason) {
+        qDebug() << "Ignoring mesh cache for" << sourcePath << "-" << reason;
+        return nullptr;
+    }
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,163 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include "bounds.h"
+#include "qcolor.h"
+#include "qfile.h"
+#include "qvectornd.h"
+#include <QVector>
+#include <memory>
+
+// Read-only view over a contiguous array that is owned elsewhere
+template <typename T> class ArrayView {
+  public:
+    ArrayView() = default;
+
+    ArrayView(const T *data, int size) : ptr(data), count(size) {}
+
+    ArrayView(const QVector<T> &vector)
+        : ptr(vector.constData()), count(vector.size()) {}
+
+    const T *data() const { return ptr; }
+
+    const T *constData() const { return ptr; }
+
+    int size() const { return count; }
+
+    bool isEmpty() const { return count == 0; }
+
+    const T &operator[](int i) const { return ptr[i]; }
+
+    const T *begin() const { return ptr; }
+
+    const T *end() const { return ptr + count; }
+
+  private:
+    const T *ptr = nullptr;
+    int count = 0;
+};
+
+// Orientation of a mesh's triangles, established when the mesh is built
+enum class MeshWinding : quint32 {
+    Unknown, // Open or inconsistently wound, both sides may be visible
+    Outward  // Closed, counter-clockwise when seen from outside
+};
+
+// Immutable vertex, index and color buffers of a mesh. The buffers either
+// live in QVectors owned by this object or directly in the pages of a
+// memory-mapped file, which stays mapped for as long as the MeshData exists.
+// Models share a MeshData through a shared pointer and never copy its
+// contents.
+//
+// Every triangle has a packed 0xAARRGGBB color. Meshes built without colors
+// get the palette, which a renderer shifts per model with offsetColor() to
+// continue it across the models of a scene.
+class MeshData {
+  public:
+    // Take ownership of the given buffers. Without one color per triangle
+    // the triangles are colored with the palette.
+    static std::shared_ptr<const MeshData>
+    create(QVector<QVector3D> vertices, QVector<quint32> indices,
+           MeshWinding winding = MeshWinding::Unknown,
+           QVector<quint32> colors = QVector<quint32>()) {
+        std::shared_ptr<MeshData> mesh(new MeshData());
+        int triangleCount = indices.size() / 3;
+        if (colors.size() != triangleCount) {
+            colors.resize(triangleCount);
+            for (int i = 0; i < triangleCount; ++i) {
+                colors[i] = paletteColor(i);
+            }
+        }
+        mesh->ownedVertices = vertices;
+        mesh->ownedIndices = indices;
+        mesh->ownedColors = colors;
+        mesh->meshWinding = winding;
+        mesh->vertexView = ArrayView<QVector3D>(mesh->ownedVertices);
+        mesh->indexView = ArrayView<quint32>(mesh->ownedIndices);
+        mesh->colorView = ArrayView<quint32>(mesh->ownedColors);
+        for (const QVector3D &vertex : mesh->vertexView) {
+            mesh->box.extend(vertex);
+        }
+        mesh->sphere = BoundingSphere::around(mesh->box, mesh->vertexView);
+        return mesh;
+    }
+
+    // Wrap buffers inside a mapping of file. The MeshData keeps the file
+    // open, and with it the mapping, until it is destroyed.
+    static std::shared_ptr<const MeshData>
+    fromMapping(std::unique_ptr<QFile> file, ArrayView<QVector3D> vertices,
+                ArrayView<quint32> indices, ArrayView<quint32> colors,
+                const Aabb &bounds, const BoundingSphere &boundingSphere,
+                MeshWinding winding) {
+        std::shared_ptr<MeshData> mesh(new MeshData());
+        mesh->meshWinding = winding;
+        mesh->mappedFile = std::move(file);
+        mesh->vertexView = vertices;
+        mesh->indexView = indices;
+        mesh->colorView = colors;
+        mesh->box = bounds;
+        mesh->sphere = boundingSphere;
+        return mesh;
+    }
+
+    ArrayView<QVector3D> vertices() const { return vertexView; }
+
+    ArrayView<quint32> indices() const { return indexView; }
+
+    // One color per triangle
+    ArrayView<quint32> colors() const { return colorView; }
+
+    const Aabb &bounds() const { return box; }
+
+    const BoundingSphere &boundingSphere() const { return sphere; }
+
+    MeshWinding winding() const { return meshWinding; }
+
+    // True if the buffers point into a mapped file
+    bool isMapped() const { return mappedFile != nullptr; }
+
+    // Palette color of the i-th triangle
+    static quint32 paletteColor(qint64 i) {
+        // Unsigned arithmetic wraps without changing the low 8 bits, so any
+        // triangle count gives the same bytes as exact arithmetic
+        quint32 n = quint32(i);
+        int r = (n * 123 + 45) & 0xff; // Simple color generation logic
+        int g = (n * 234 + 67) & 0xff;
+        int b = (n * 345 + 89) & 0xff;
+        return qRgb(r, g, b);
+    }
+
+    // Offset that turns paletteColor(i) into paletteColor(i + triangles)
+    // when passed to offsetColor()
+    static quint32 paletteOffset(qint64 triangles) {
+        quint32 n = quint32(triangles); // Wraps like paletteColor()
+        return (n * 123 & 0xff) << 16 | (n * 234 & 0xff) << 8 |
+               (n * 345 & 0xff);
+    }
+
+    // Add the red, green and blue bytes of offset to those of color, each
+    // wrapping around at 256. Alpha is kept.
+    static quint32 offsetColor(quint32 color, quint32 offset) {
+        quint32 redBlue = ((color & 0x00ff00ff) + (offset & 0x00ff00ff)) &
+                          0x00ff00ff;
+        quint32 green = ((color & 0x0000ff00) + (offset & 0x0000ff00)) &
+                        0x0000ff00;
+        return (color & 0xff000000) | redBlue | green;
+    }
+
+  private:
+    MeshData() = default;
+
+    QVector<QVector3D> ownedVertices;
+    QVector<quint32> ownedIndices;
+    QVector<quint32> ownedColors;
+    std::unique_ptr<QFile> mappedFile;
+    ArrayView<QVector3D> vertexView;
+    ArrayView<quint32> indexView;
+    ArrayView<quint32> colorView;
+    Aabb box;
+    BoundingSphere sphere;
+    MeshWinding meshWinding = MeshWinding::Unknown;
+};
+
+#endif // MESHDATA_H
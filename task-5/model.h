@@ -1,24 +1,245 @@
 #ifndef MODEL_H
 #define MODEL_H
+#include "meshdata.h"
 #include "qcontainerfwd.h"
+#include "qdebug.h"
 #include "qvectornd.h"
+#include "simplifier.h"
 #include <QVector>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
 
 class Model {
   public:
-    Model(QVector<QVector3D> points) : trianglePoints(points) {}
+    // Indexed mesh: every 3 indices form a triangle of vertices. Triangles
+    // with an index outside vertices and trailing indices that do not form a
+    // whole triangle are dropped.
+    Model(QVector<QVector3D> vertices, QVector<quint32> indices) {
+        dropInvalidTriangles(vertices.size(), indices);
+        deduplicate(vertices, indices);
+        MeshWinding winding = normalizeWinding(vertices, indices);
+        mesh = MeshData::create(vertices, indices, winding);
+    }
+
+    // Triangle soup: every 3 points form a triangle. Shared corners are
+    // merged into a single vertex.
+    Model(QVector<QVector3D> points) {
+        QVector<quint32> indices(points.size() - points.size() % 3);
+        for (int i = 0; i < indices.size(); ++i) {
+            indices[i] = i;
+        }
+        deduplicate(points, indices);
+        MeshWinding winding = normalizeWinding(points, indices);
+        mesh = MeshData::create(points, indices, winding);
+    }
+
+    // Use existing mesh buffers as they are, without copying them
+    explicit Model(std::shared_ptr<const MeshData> mesh) : mesh(mesh) {}
 
-    // Virtual destructor to ensure proper cleanup of derived classes
     ~Model() = default;
 
-    QVector<QVector3D> getTrianglePoints() const { return trianglePoints; }
+    // Unique vertex positions
+    ArrayView<QVector3D> getVertices() const { return mesh->vertices(); }
+
+    // Three indices into getVertices() per triangle
+    ArrayView<quint32> getIndices() const { return mesh->indices(); }
+
+    // Packed 0xAARRGGBB color per triangle
+    ArrayView<quint32> getColors() const { return mesh->colors(); }
+
+    // Shared buffers behind this model
+    const std::shared_ptr<const MeshData> &getMesh() const { return mesh; }
+
+    // Bounding volumes, computed once when the mesh is built
+    const Aabb &getBounds() const { return mesh->bounds(); }
+
+    const BoundingSphere &getBoundingSphere() const {
+        return mesh->boundingSphere();
+    }
+
+    // Expanded triangle soup, 3 points per triangle. This copies every
+    // corner, prefer getVertices() and getIndices().
+    QVector<QVector3D> getTrianglePoints() const {
+        ArrayView<QVector3D> vertices = getVertices();
+        QVector<QVector3D> points;
+        points.reserve(getIndices().size());
+        for (quint32 index : getIndices()) {
+            points.append(vertices[index]);
+        }
+        return points;
+    }
+
+    int getTriangleCount() const { return getIndices().size() / 3; }
+
+    int getVertexCount() const { return getVertices().size(); }
+
+    // Outward if back faces can be culled safely
+    MeshWinding getWinding() const { return mesh->winding(); }
 
-    int getTriangleCount() const { return trianglePoints.size() / 3; }
+    // Build up to levels - 1 simplified versions of the mesh, each with
+    // about a quarter of the triangles of the one before. Copies of this
+    // model made afterwards share them.
+    void buildLods(int levels) {
+        lods = std::make_shared<const QVector<std::shared_ptr<const MeshData>>>(
+            MeshSimplifier::buildLevels(*mesh, levels - 1, 0.25f));
+    }
+
+    // Levels of detail, 1 until buildLods() is called. Level 0 is the mesh
+    // itself and higher levels are coarser.
+    int getLodCount() const { return lods ? lods->size() + 1 : 1; }
+
+    const MeshData &getLod(int level) const {
+        return level == 0 ? *mesh : *(*lods)[level - 1];
+    }
 
   protected:
-    // Vector of 3D points representing the vertices of triangles. Each 3 points
-    // form a triangle.
-    QVector<QVector3D> trianglePoints;
+    // Unique 3D points and the index buffer, each 3 indices form a triangle
+    std::shared_ptr<const MeshData> mesh;
+
+    // Simplified meshes of levels 1 and up, shared by copies of the model
+    std::shared_ptr<const QVector<std::shared_ptr<const MeshData>>> lods;
+
+  private:
+    // Keep the whole triangles whose indices are all below vertexCount
+    static void dropInvalidTriangles(int vertexCount,
+                                     QVector<quint32> &indices) {
+        int kept = 0;
+        int whole = indices.size() - indices.size() % 3;
+        for (int i = 0; i < whole; i += 3) {
+            if (indices[i] < (quint32)vertexCount &&
+                indices[i + 1] < (quint32)vertexCount &&
+                indices[i + 2] < (quint32)vertexCount) {
+                indices[kept++] = indices[i];
+                indices[kept++] = indices[i + 1];
+                indices[kept++] = indices[i + 2];
+            }
+        }
+        if (kept != indices.size()) {
+            qWarning() << "Dropped" << indices.size() - kept
+                       << "indices outside the vertex buffer or of an"
+                       << "incomplete triangle";
+            indices.resize(kept);
+        }
+    }
+
+    // Merge vertices with bit-identical positions and drop unreferenced ones,
+    // remapping the index buffer to match
+    static void deduplicate(QVector<QVector3D> &vertices,
+                            QVector<quint32> &indices) {
+        struct PositionKey {
+            quint32 bits[3];
+            bool operator==(const PositionKey &other) const {
+                return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+            }
+        };
+        struct PositionHash {
+            size_t operator()(const PositionKey &key) const {
+                size_t hash = key.bits[0];
+                hash = hash * 31 + key.bits[1];
+                return hash * 31 + key.bits[2];
+            }
+        };
+
+        std::unordered_map<PositionKey, quint32, PositionHash> unique;
+        unique.reserve(vertices.size());
+        QVector<qint64> remap(vertices.size(), -1);
+        QVector<QVector3D> merged;
+        merged.reserve(vertices.size());
+
+        for (quint32 &index : indices) {
+            if (remap[index] < 0) {
+                PositionKey key;
+                std::memcpy(key.bits, &vertices[index], sizeof(key.bits));
+                auto inserted = unique.emplace(key, merged.size());
+                if (inserted.second) {
+                    merged.append(vertices[index]);
+                }
+                remap[index] = inserted.first->second;
+            }
+            index = remap[index];
+        }
+        vertices = merged;
+    }
+
+    // Make a closed mesh wind counter-clockwise when seen from outside.
+    //
+    // The mesh is closed and consistently wound if every directed edge
+    // appears once and its reverse appears too. The signed volume of each
+    // shell, the triangles connected through shared edges, then tells
+    // whether it faces out or in. If all shells face in, the mesh is
+    // flipped. Shells that disagree may be a cavity or a mistake, so such a
+    // mesh is left alone, like any other, and reported as Unknown; back-face
+    // culling is then never applied to it.
+    static MeshWinding normalizeWinding(const QVector<QVector3D> &vertices,
+                                        QVector<quint32> &indices) {
+        auto edgeKey = [](quint32 from, quint32 to) {
+            return (quint64)from << 32 | to;
+        };
+
+        int triangleCount = indices.size() / 3;
+        std::unordered_map<quint64, int> edges; // Directed edge to triangle
+        edges.reserve(indices.size());
+        for (int t = 0; t < triangleCount; ++t) {
+            quint32 corners[3] = {indices[3 * t], indices[3 * t + 1],
+                                  indices[3 * t + 2]};
+            for (int k = 0; k < 3; ++k) {
+                quint32 from = corners[k], to = corners[(k + 1) % 3];
+                if (from == to || !edges.emplace(edgeKey(from, to), t).second)
+                    return MeshWinding::Unknown;
+            }
+        }
+
+        // Union-find over triangles, joined across every edge
+        QVector<int> shell(triangleCount);
+        for (int t = 0; t < triangleCount; ++t) {
+            shell[t] = t;
+        }
+        auto root = [&shell](int t) {
+            while (shell[t] != t) {
+                shell[t] = shell[shell[t]];
+                t = shell[t];
+            }
+            return t;
+        };
+        for (const auto &edge : edges) {
+            auto reverse = edges.find(
+                edgeKey(edge.first & 0xffffffffu, edge.first >> 32));
+            if (reverse == edges.end())
+                return MeshWinding::Unknown;
+            shell[root(edge.second)] = root(reverse->second);
+        }
+
+        // Six times the signed volume of each shell, by the divergence
+        // theorem, summed at the shell's root
+        QVector<double> volumes(triangleCount, 0.0);
+        for (int t = 0; t < triangleCount; ++t) {
+            const QVector3D &a = vertices[indices[3 * t]];
+            const QVector3D &b = vertices[indices[3 * t + 1]];
+            const QVector3D &c = vertices[indices[3 * t + 2]];
+            volumes[root(t)] +=
+                a.x() * ((double)b.y() * c.z() - (double)b.z() * c.y()) +
+                a.y() * ((double)b.z() * c.x() - (double)b.x() * c.z()) +
+                a.z() * ((double)b.x() * c.y() - (double)b.y() * c.x());
+        }
+        bool outward = false, inward = false;
+        for (int t = 0; t < triangleCount; ++t) {
+            if (root(t) != t)
+                continue;
+            if (volumes[t] == 0)
+                return MeshWinding::Unknown;
+            outward = outward || volumes[t] > 0;
+            inward = inward || volumes[t] < 0;
+        }
+        if (outward == inward) // Disagreeing shells, or no triangles
+            return MeshWinding::Unknown;
+        if (inward) {
+            for (int i = 0; i + 2 < indices.size(); i += 3) {
+                std::swap(indices[i + 1], indices[i + 2]);
+            }
+        }
+        return MeshWinding::Outward;
+    }
 };
 
-#endif // MODEL_H
\ No newline at end of file
+#endif // MODEL_H
@@ -0,0 +1,294 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "qdebug.h"
+#include "qfile.h"
+#include "qvectornd.h"
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <charconv>
+#include <cstring>
+
+// Geometry parsed from an OBJ file. Polygons are fan-triangulated, so every
+// 3 indices form a triangle.
+struct ObjMesh {
+    QVector<QVector3D> vertices;
+    QVector<quint32> indices;
+    qint64 faceCount = 0;         // Polygons read, before triangulation
+    qint64 skippedFaces = 0;      // Faces dropped for out-of-range indices
+    qint64 malformedVertices = 0; // v lines with fewer than 3 numbers
+};
+
+// ObjLoader reads the geometric subset of Wavefront OBJ (v and f lines).
+//
+// The file is memory-mapped and parsed in place with std::from_chars. Large
+// files are split into line-aligned chunks that are parsed in parallel in two
+// passes: the first counts vertices and triangles per chunk, which gives
+// every chunk a fixed output range in preallocated arrays; the second parses
+// straight into that range. Faces may have any number of corners, indices may
+// be negative (relative to the last vertex), and v lines may carry a w
+// component or arbitrary whitespace.
+class ObjLoader {
+  public:
+    static constexpr qint64 MinChunkBytes = 1 << 20;
+
+    static bool load(const QString &filePath, ObjMesh &mesh,
+                     int threadCount = 0) {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qDebug() << "Could not open file:" << filePath;
+            return false;
+        }
+
+        qint64 size = file.size();
+        if (size == 0) {
+            mesh = ObjMesh();
+            return true;
+        }
+
+        // Compressed resources cannot be mapped, fall back to a copy
+        const uchar *mapped = file.map(0, size);
+        if (mapped) {
+            parse(reinterpret_cast<const char *>(mapped), size, mesh,
+                  threadCount);
+            file.unmap(const_cast<uchar *>(mapped));
+        } else {
+            QByteArray data = file.readAll();
+            parse(data.constData(), data.size(), mesh, threadCount);
+        }
+        return true;
+    }
+
+    // Parse OBJ text. threadCount <= 0 uses one chunk per ideal thread.
+    static void parse(const char *data, qint64 size, ObjMesh &mesh,
+                      int threadCount = 0) {
+        if (threadCount <= 0)
+            threadCount = QThread::idealThreadCount();
+
+        QVector<Chunk> chunks = split(data, size, threadCount);
+        QtConcurrent::blockingMap(chunks, [](Chunk &chunk) { count(chunk); });
+
+        // Give every chunk its own output range
+        qint64 vertexCount = 0, indexCount = 0;
+        for (Chunk &chunk : chunks) {
+            chunk.vertexBase = vertexCount;
+            chunk.indexBase = indexCount;
+            vertexCount += chunk.vertexCount;
+            indexCount += chunk.triangleCount * 3;
+        }
+
+        mesh = ObjMesh();
+        mesh.vertices.resize(vertexCount);
+        mesh.indices.resize(indexCount);
+        QVector3D *vertices = mesh.vertices.data();
+        quint32 *indices = mesh.indices.data();
+        QtConcurrent::blockingMap(chunks, [=](Chunk &chunk) {
+            read(chunk, vertices, indices, vertexCount);
+        });
+
+        for (const Chunk &chunk : chunks) {
+            mesh.faceCount += chunk.faceCount;
+            mesh.skippedFaces += chunk.skippedFaces;
+            mesh.malformedVertices += chunk.malformedVertices;
+        }
+        if (mesh.skippedFaces > 0)
+            removeInvalidTriangles(mesh);
+    }
+
+  private:
+    // Marks the corners of triangles from faces with bad indices
+    static constexpr quint32 InvalidIndex = 0xffffffffu;
+
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        qint64 vertexCount = 0;
+        qint64 triangleCount = 0;
+        qint64 vertexBase = 0; // First output vertex of this chunk
+        qint64 indexBase = 0;  // First output index of this chunk
+        qint64 faceCount = 0;
+        qint64 skippedFaces = 0;
+        qint64 malformedVertices = 0;
+    };
+
+    static QVector<Chunk> split(const char *data, qint64 size,
+                                int threadCount) {
+        qint64 chunkCount =
+            std::max<qint64>(1, std::min<qint64>(threadCount,
+                                                 size / MinChunkBytes));
+        qint64 chunkSize = size / chunkCount;
+
+        QVector<Chunk> chunks;
+        const char *end = data + size;
+        const char *begin = data;
+        while (begin < end) {
+            const char *cut = begin + chunkSize;
+            if (chunks.size() == chunkCount - 1 || cut >= end) {
+                cut = end;
+            } else {
+                // Move the cut past the end of the current line
+                const char *newline = static_cast<const char *>(
+                    std::memchr(cut, '\n', end - cut));
+                cut = newline ? newline + 1 : end;
+            }
+            Chunk chunk;
+            chunk.begin = begin;
+            chunk.end = cut;
+            chunks.append(chunk);
+            begin = cut;
+        }
+        return chunks;
+    }
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char *skipSpaces(const char *p, const char *end) {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    static const char *lineEnd(const char *p, const char *end) {
+        const char *newline =
+            static_cast<const char *>(std::memchr(p, '\n', end - p));
+        return newline ? newline : end;
+    }
+
+    // Type of a line from its keyword: 'v', 'f' or 0 for anything else
+    static char lineType(const char *&p, const char *end) {
+        p = skipSpaces(p, end);
+        if (end - p >= 2 && isSpace(p[1])) {
+            if (*p == 'v' || *p == 'f') {
+                char type = *p;
+                p += 2;
+                return type;
+            }
+        }
+        return 0;
+    }
+
+    // Number of whitespace-separated tokens up to the end of the line
+    static int countTokens(const char *p, const char *end) {
+        int tokens = 0;
+        while (true) {
+            p = skipSpaces(p, end);
+            if (p >= end)
+                return tokens;
+            ++tokens;
+            while (p < end && !isSpace(*p))
+                ++p;
+        }
+    }
+
+    // First pass: count vertices and triangles so that the second pass can
+    // write straight into preallocated arrays
+    static void count(Chunk &chunk) {
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            const char *eol = lineEnd(p, chunk.end);
+            char type = lineType(p, eol);
+            if (type == 'v') {
+                chunk.vertexCount++;
+            } else if (type == 'f') {
+                chunk.triangleCount += std::max(0, countTokens(p, eol) - 2);
+            }
+            p = eol + 1;
+        }
+    }
+
+    // Second pass: parse vertices and fan-triangulate faces into the chunk's
+    // output range
+    static void read(Chunk &chunk, QVector3D *vertices, quint32 *indices,
+                     qint64 totalVertices) {
+        QVector3D *vertexOut = vertices + chunk.vertexBase;
+        quint32 *indexOut = indices + chunk.indexBase;
+        qint64 vertexIndex = chunk.vertexBase; // Vertices defined so far
+
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            const char *eol = lineEnd(p, chunk.end);
+            char type = lineType(p, eol);
+            if (type == 'v') {
+                float xyz[3] = {0, 0, 0};
+                int parsed = 0;
+                while (parsed < 3) {
+                    p = skipSpaces(p, eol);
+                    if (p < eol && *p == '+')
+                        ++p;
+                    auto result = std::from_chars(p, eol, xyz[parsed]);
+                    if (result.ec != std::errc())
+                        break;
+                    p = result.ptr;
+                    parsed++;
+                }
+                if (parsed < 3)
+                    chunk.malformedVertices++;
+                *vertexOut++ = QVector3D(xyz[0], xyz[1], xyz[2]);
+                vertexIndex++;
+            } else if (type == 'f') {
+                quint32 first = 0, previous = 0;
+                int corners = 0;
+                bool valid = true;
+                while (true) {
+                    p = skipSpaces(p, eol);
+                    if (p >= eol)
+                        break;
+
+                    // Corner is i, i/t, i//n or i/t/n; only i is used
+                    qint64 index = 0;
+                    auto result = std::from_chars(p, eol, index);
+                    while (p < eol && !isSpace(*p))
+                        ++p;
+
+                    // OBJ indices are 1-based, negative ones count back from
+                    // the last vertex defined before this face
+                    index = index < 0 ? vertexIndex + index : index - 1;
+                    quint32 corner = (quint32)index;
+                    if (result.ec != std::errc() || index < 0 ||
+                        index >= totalVertices) {
+                        valid = false;
+                        corner = InvalidIndex;
+                    }
+
+                    if (corners == 0) {
+                        first = corner;
+                    } else if (corners >= 2) {
+                        *indexOut++ = first;
+                        *indexOut++ = previous;
+                        *indexOut++ = corner;
+                    }
+                    previous = corner;
+                    corners++;
+                }
+
+                if (corners >= 3) {
+                    chunk.faceCount++;
+                    if (!valid) {
+                        // Make sure every triangle of the face is dropped
+                        for (int i = 0; i < (corners - 2) * 3; ++i)
+                            indexOut[-1 - i] = InvalidIndex;
+                        chunk.skippedFaces++;
+                    }
+                }
+            }
+            p = eol + 1;
+        }
+    }
+
+    static void removeInvalidTriangles(ObjMesh &mesh) {
+        int kept = 0;
+        for (int i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            if (mesh.indices[i] == InvalidIndex ||
+                mesh.indices[i + 1] == InvalidIndex ||
+                mesh.indices[i + 2] == InvalidIndex)
+                continue;
+            mesh.indices[kept++] = mesh.indices[i];
+            mesh.indices[kept++] = mesh.indices[i + 1];
+            mesh.indices[kept++] = mesh.indices[i + 2];
+        }
+        mesh.indices.resize(kept);
+    }
+};
+
+#endif // OBJLOADER_H
@@ -0,0 +1,153 @@
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include "qrect.h"
+#include "qvectornd.h"
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// OcclusionBuffer is a small depth buffer for whole-model occlusion culling.
+// Occluders are drawn into it before the frame, and the screen rectangle of
+// every other model is then tested against it; a model whose rectangle is
+// entirely behind occluders is skipped before its vertices are transformed.
+//
+// Both sides are conservative. An occluder only writes buffer pixels its
+// triangle covers completely, with the farthest depth the triangle has in
+// them, so every stored depth is at or beyond what the full-resolution pass
+// will draw there. A model is occluded only if every buffer pixel its
+// rectangle touches lies in front of its nearest point.
+class OcclusionBuffer {
+  public:
+    static constexpr int Width = 256;
+    static constexpr int Height = 128;
+
+    // Start a frame for a render target of the given size; input coordinates
+    // are in its pixels
+    void begin(int targetWidth, int targetHeight) {
+        scaleX = double(Width) / std::max(1, targetWidth);
+        scaleY = double(Height) / std::max(1, targetHeight);
+        depth.fill(std::numeric_limits<float>::max(), Width * Height);
+        empty = true;
+    }
+
+    // True until an occluder has covered a buffer pixel
+    bool isEmpty() const { return empty; }
+
+    // Draw an occluder triangle given in target pixels with view depth in z.
+    // All corners must be in front of the near plane.
+    void addTriangle(const QVector3D &p1, const QVector3D &p2,
+                     const QVector3D &p3) {
+        double x[3] = {p1.x() * scaleX, p2.x() * scaleX, p3.x() * scaleX};
+        double y[3] = {p1.y() * scaleY, p2.y() * scaleY, p3.y() * scaleY};
+        double z[3] = {p1.z(), p2.z(), p3.z()};
+
+        // Buffer pixel (i, j) is the square [i, i + 1) x [j, j + 1); only
+        // squares inside the bounding box can be covered completely
+        int minX = std::max(0, (int)std::ceil(std::min({x[0], x[1], x[2]})));
+        int minY = std::max(0, (int)std::ceil(std::min({y[0], y[1], y[2]})));
+        int maxX =
+            std::min(Width, (int)std::floor(std::max({x[0], x[1], x[2]})));
+        int maxY =
+            std::min(Height, (int)std::floor(std::max({y[0], y[1], y[2]})));
+        if (minX >= maxX || minY >= maxY)
+            return;
+
+        double area =
+            (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area == 0)
+            return;
+
+        // Edge functions, non-negative inside, and the depth plane
+        double a[3], b[3], c[3];
+        double za = 0, zb = 0, zc = 0;
+        for (int i = 0; i < 3; ++i) {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            a[i] = y[j] - y[k];
+            b[i] = x[k] - x[j];
+            c[i] = x[j] * y[k] - x[k] * y[j];
+            if (area < 0) {
+                a[i] = -a[i];
+                b[i] = -b[i];
+                c[i] = -c[i];
+            }
+            double weight = z[i] / std::fabs(area);
+            za += a[i] * weight;
+            zb += b[i] * weight;
+            zc += c[i] * weight;
+        }
+        double farthest = std::max({z[0], z[1], z[2]});
+
+        // Squares are grown by a fraction of a target pixel, since the
+        // fixed-point kernel moves vertices by up to 1/32 pixel. A square is
+        // inside an edge if its corner with the smallest edge value is, and
+        // its largest depth is at the corner farthest along the depth plane.
+        double marginX = SnapMargin * scaleX, marginY = SnapMargin * scaleY;
+        double sideX = 1 + 2 * marginX, sideY = 1 + 2 * marginY;
+        double cornerA[3], cornerB[3];
+        for (int i = 0; i < 3; ++i) {
+            cornerA[i] = std::min(a[i], 0.0) * sideX;
+            cornerB[i] = std::min(b[i], 0.0) * sideY;
+        }
+        double farA = std::max(za, 0.0) * sideX;
+        double farB = std::max(zb, 0.0) * sideY;
+
+        for (int py = minY; py < maxY; ++py) {
+            float *row = depth.data() + py * Width;
+            double sy = py - marginY;
+            for (int px = minX; px < maxX; ++px) {
+                double sx = px - marginX;
+                bool covered = true;
+                for (int i = 0; i < 3 && covered; ++i) {
+                    double edge = a[i] * sx + b[i] * sy + c[i];
+                    covered = edge + cornerA[i] + cornerB[i] >= 0;
+                }
+                if (!covered)
+                    continue;
+                double z = za * sx + zb * sy + zc + farA + farB;
+                float value = (float)std::min(z, farthest);
+                if (value < row[px]) {
+                    row[px] = value;
+                    empty = false;
+                }
+            }
+        }
+    }
+
+    // True if everything inside rect (target pixels) at a view depth of
+    // nearest or more is hidden by the occluders. The scanline kernel rounds
+    // span ends to the nearest pixel, so rect is grown by a pixel, and the
+    // margin on the buffer depths covers the float rounding of the kernels.
+    bool isOccluded(const QRectF &rect, float nearest) const {
+        int minX = std::max(0, (int)std::floor((rect.left() - 1) * scaleX));
+        int minY = std::max(0, (int)std::floor((rect.top() - 1) * scaleY));
+        int maxX =
+            std::min(Width - 1, (int)std::floor((rect.right() + 1) * scaleX));
+        int maxY = std::min(Height - 1,
+                            (int)std::floor((rect.bottom() + 1) * scaleY));
+        if (minX > maxX || minY > maxY)
+            return false;
+
+        float limit = nearest * (1.0f - DepthMargin);
+        for (int py = minY; py <= maxY; ++py) {
+            const float *row = depth.constData() + py * Width;
+            for (int px = minX; px <= maxX; ++px) {
+                if (!(row[px] < limit))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    static constexpr float DepthMargin = 1e-4f;
+    static constexpr double SnapMargin = 0.125; // Target pixels
+
+    double scaleX = 1;
+    double scaleY = 1;
+    QVector<float> depth; // Row-major, Width * Height
+    bool empty = true;
+};
+
+#endif // OCCLUSIONBUFFER_H
@@ -0,0 +1,287 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "qdebug.h"
+#include <QMutex>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Profiler records how long the stages of a frame take. Stages are timed by
+// ProfileScope objects and written to a ring buffer owned by the thread that
+// ran them, so recording takes no lock and threads never wait for each other.
+// The rings can be summed up for a live display or written out as a Chrome
+// trace (chrome://tracing, Perfetto) that shows every stage on its thread.
+//
+// Profiling is off by default. A scope then costs one relaxed atomic load and
+// no clock read, so scopes can stay in the pipeline for good. Each ring keeps
+// the last RingSize scopes of its thread; older ones are overwritten.
+class Profiler {
+  public:
+    // Stage names used by the pipeline, in pipeline order
+    static constexpr const char *Frame = "frame"; // All of renderScene()
+    static constexpr const char *Clear = "clear";
+    static constexpr const char *Cull = "cull"; // Frustum and occlusion
+    static constexpr const char *Transform = "transform";
+    static constexpr const char *Clip = "clip"; // Triangle setup and clipping
+    static constexpr const char *Bin = "bin";
+    static constexpr const char *Raster = "raster";
+    static constexpr const char *Resolve = "resolve"; // Deferred clears
+    static constexpr const char *Present = "present";
+
+    static constexpr int RingSize = 1 << 16; // Scopes kept per thread
+
+    // Total time of one stage in a time window
+    struct StageTime {
+        const char *name;
+        qint64 nanoseconds = 0;
+        int count = 0; // Scopes of the stage in the window
+    };
+
+    static void setEnabled(bool on) {
+        enabled.store(on, std::memory_order_relaxed);
+    }
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the first call, on a clock shared by all threads
+    static qint64 now() {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - epoch)
+            .count();
+    }
+
+    // Append a scope that ran on the calling thread. name must stay valid
+    // for the lifetime of the program, e.g. a string literal.
+    static void record(const char *name, qint64 start, qint64 end) {
+        Ring &ring = localRing();
+        quint64 index = ring.head.load(std::memory_order_relaxed);
+        // Announce the overwrite before touching the slot, so a reader
+        // copying the same slot can tell its copy may be torn
+        ring.reserved.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot &slot = ring.entries[index % RingSize];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.duration.store(end - start, std::memory_order_relaxed);
+        ring.head.store(index + 1, std::memory_order_release);
+    }
+
+    // Name the calling thread in traces, e.g. "render". This also creates
+    // the thread's ring, so its first scope does not allocate.
+    static void setThreadName(const QString &name) {
+        threadName() = name;
+        Ring &ring = localRing();
+        QMutexLocker lock(&ringsMutex);
+        ring.name = name;
+    }
+
+    // Time per stage of all scopes that started in [from, to), summed over
+    // threads. Pipeline stages come first, in pipeline order, followed by
+    // any others; stages without scopes in the window are left out.
+    static QVector<StageTime> summarize(qint64 from, qint64 to) {
+        const char *const order[] = {Frame, Clear,  Cull,    Transform, Clip,
+                                     Bin,   Raster, Resolve, Present};
+        QVector<StageTime> stages;
+        for (const char *name : order) {
+            stages.append({name});
+        }
+        for (const Event &event : snapshot()) {
+            if (event.start < from || event.start >= to)
+                continue;
+            auto stage = std::find_if(
+                stages.begin(), stages.end(), [&](const StageTime &s) {
+                    return std::strcmp(s.name, event.name) == 0;
+                });
+            if (stage == stages.end()) {
+                stages.append({event.name});
+                stage = stages.end() - 1;
+            }
+            stage->nanoseconds += event.duration;
+            stage->count++;
+        }
+        stages.erase(std::remove_if(stages.begin(), stages.end(),
+                                    [](const StageTime &s) {
+                                        return s.count == 0;
+                                    }),
+                     stages.end());
+        return stages;
+    }
+
+    // Write every recorded scope as a Chrome trace JSON file
+    static bool writeChromeTrace(const QString &path) {
+        QVector<Event> events = snapshot();
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            qWarning() << "Could not write trace:" << path;
+            return false;
+        }
+        QTextStream out(&file);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto separator = [&]() -> const char * {
+            bool wasFirst = first;
+            first = false;
+            return wasFirst ? "" : ",\n";
+        };
+        {
+            QMutexLocker lock(&ringsMutex);
+            for (int i = 0; i < int(rings.size()); ++i) {
+                QString name = rings[i]->name.isEmpty()
+                                   ? QString("worker %1").arg(i + 1)
+                                   : rings[i]->name;
+                out << separator()
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                       "\"tid\":"
+                    << i + 1 << ",\"args\":{\"name\":\"" << escaped(name)
+                    << "\"}}";
+            }
+        }
+        // Timestamps and durations are in microseconds
+        for (const Event &event : events) {
+            out << separator() << "{\"name\":\""
+                << escaped(QString::fromUtf8(event.name))
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread + 1
+                << ",\"ts\":" << QString::number(event.start / 1e3, 'f', 3)
+                << ",\"dur\":"
+                << QString::number(event.duration / 1e3, 'f', 3) << "}";
+        }
+        out << "\n]}\n";
+        out.flush();
+        if (!file.commit()) {
+            qWarning() << "Could not write trace:" << path;
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    struct Slot {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<qint64> start{0};
+        std::atomic<qint64> duration{0};
+    };
+
+    // Scopes of one thread. Only the owning thread writes; head counts the
+    // slots written and reserved the slots being written.
+    struct Ring {
+        std::unique_ptr<Slot[]> entries{new Slot[RingSize]};
+        std::atomic<quint64> head{0};
+        std::atomic<quint64> reserved{0};
+        QString name; // Guarded by ringsMutex
+    };
+
+    struct Event {
+        const char *name;
+        qint64 start;
+        qint64 duration;
+        int thread; // Index into rings
+    };
+
+    static inline std::atomic<bool> enabled{false};
+    static inline QMutex ringsMutex;
+    static inline std::vector<std::unique_ptr<Ring>> rings; // Never shrinks
+
+    // Contents of a JSON string literal for text
+    static QString escaped(const QString &text) {
+        QString result;
+        result.reserve(text.size());
+        for (QChar c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c.unicode() < 0x20) {
+                result += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    static QString &threadName() {
+        thread_local QString name;
+        return name;
+    }
+
+    static Ring *&ownRing() {
+        thread_local Ring *ring = nullptr;
+        return ring;
+    }
+
+    // Ring of the calling thread, created by its first scope. Rings outlive
+    // their threads, so scopes of finished threads still show in traces.
+    static Ring &localRing() {
+        Ring *&ring = ownRing();
+        if (!ring) {
+            std::unique_ptr<Ring> created(new Ring);
+            created->name = threadName();
+            QMutexLocker lock(&ringsMutex);
+            ring = created.get();
+            rings.push_back(std::move(created));
+        }
+        return *ring;
+    }
+
+    // Copy of the scopes in all rings. Slots that were overwritten while
+    // they were copied are dropped.
+    static QVector<Event> snapshot() {
+        QVector<Event> events;
+        QMutexLocker lock(&ringsMutex);
+        for (int thread = 0; thread < int(rings.size()); ++thread) {
+            const Ring &ring = *rings[thread];
+            quint64 head = ring.head.load(std::memory_order_acquire);
+            quint64 first = head > RingSize ? head - RingSize : 0;
+            int copied = events.size();
+            for (quint64 i = first; i < head; ++i) {
+                const Slot &slot = ring.entries[i % RingSize];
+                events.append({slot.name.load(std::memory_order_relaxed),
+                               slot.start.load(std::memory_order_relaxed),
+                               slot.duration.load(std::memory_order_relaxed),
+                               thread});
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            quint64 reserved = ring.reserved.load(std::memory_order_relaxed);
+            quint64 valid = reserved > RingSize ? reserved - RingSize : 0;
+            if (valid > first) {
+                int torn = int(std::min(valid, head) - first);
+                events.erase(events.begin() + copied,
+                             events.begin() + copied + torn);
+            }
+        }
+        return events;
+    }
+};
+
+// Times the enclosing block as one scope of the named stage, if profiling
+// was enabled when the block was entered
+class ProfileScope {
+  public:
+    explicit ProfileScope(const char *name)
+        : name(name), start(Profiler::isEnabled() ? Profiler::now() : -1) {}
+
+    ~ProfileScope() { finish(); }
+
+    // End the scope before the end of the block
+    void finish() {
+        if (start >= 0)
+            Profiler::record(name, start, Profiler::now());
+        start = -1;
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+  private:
+    const char *name;
+    qint64 start; // -1 if not recording
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,856 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "camera.h"
+#include "clipper.h"
+#include "depthpyramid.h"
+#include "fixedpoint.h"
+#include "halfspace.h"
+#include "model.h"
+#include "occlusionbuffer.h"
+#include "profiler.h"
+#include "qdebug.h"
+#include "qlogging.h"
+#include "qpoint.h"
+#include "qvectornd.h"
+#include "rendertarget.h"
+#include "scene.h"
+#include "tilebinner.h"
+#include "vertexstage.h"
+#include <QtConcurrent>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Renderer owns the render pipeline: the color and depth buffers, the vertex
+// stage, culling and the fill kernels. It is not thread-safe; the Rasterizer
+// widget drives it from its render thread, and tools can use it headless.
+class Renderer {
+  public:
+    enum class RenderMode {
+        Serial, // Draw every triangle in order on the calling thread
+        Tiled   // Bin triangles into tiles and draw the tiles in parallel
+    };
+
+    enum class FillKernel {
+        ScanLine,  // fillTriangleScanLine
+        HalfSpace, // HalfSpaceRasterizer, AVX2 when the CPU supports it
+        FixedPoint // FixedPointRasterizer, exact shared edges
+    };
+
+    // Which side of closed meshes to skip. Meshes without a known winding
+    // (see MeshWinding) are always drawn from both sides.
+    enum class CullMode {
+        None, // Draw every triangle
+        Back, // Skip triangles facing away from the camera
+        Front // Skip triangles facing the camera
+    };
+
+    // Pipeline options, applied by setSettings between frames
+    struct Settings {
+        RenderMode renderMode = RenderMode::Serial;
+        FillKernel fillKernel = FillKernel::FixedPoint;
+        CullMode cullMode = CullMode::Back;
+        bool frustumCulling = true;    // Skip models outside the frustum
+        bool occlusionCulling = true;  // Skip models behind the occluders
+        bool hierarchicalZ = true;     // Skip fragments behind the pyramid
+        bool overdrawCounting = false; // See FrameStats::doubleWrites
+        bool levelOfDetail = true;     // Coarser meshes for small models
+        float lodRadius = 256; // Projected radius in pixels of level 1
+    };
+
+    // Counters of the last renderScene() call
+    struct FrameStats {
+        int modelsDrawn = 0;         // Models sent to the vertex stage
+        int modelsCulled = 0;        // Models outside the view frustum
+        int modelsOccluded = 0;      // Models hidden behind occluders
+        int trianglesDrawn = 0;      // Sent to the fill stage, after clipping
+        int trianglesClipped = 0;    // Crossing the near plane or guard band
+        int trianglesCulled = 0;     // Skipped by the cull mode
+        int trianglesOccluded = 0;   // Behind the depth pyramid everywhere
+        int trianglesSaved = 0;      // Left out by coarser levels of detail
+        qint64 fragmentsSkipped = 0; // Pixel tests saved by the depth pyramid
+        qint64 fragmentsCovered = 0; // With overdraw counting, see below
+        qint64 doubleWrites = 0;     // Pixels covered twice by one model
+    };
+
+  private:
+    // Triangle after projection, waiting in the tile bins
+    struct ScreenTriangle {
+        QVector3D p1, p2, p3;
+        QRgb color;
+        int model; // Scene index, stamps the pixels for overdraw counting
+    };
+
+    RenderTarget target;             // Color and depth buffers
+    Scene *scene;                    // Scene to render
+    QVector3D perspectiveProjection; // Perspective projection parameters
+    Settings settings;
+    FrameStats frameStats;
+    DepthPyramid depthPyramid; // Depth maxima of blocks and tiles of target
+
+    VertexStage vertexStage;       // Camera and projection for this frame
+    ScreenVertices screenVertices; // Projected vertices of the current model
+    QVector<int> visibleModels;    // Models that passed culling this frame
+    OcclusionBuffer occlusionBuffer; // Depth of the scene's occluders
+    int currentModel = -1;         // Model being drawn by renderModel
+    QVector<quint32> overdrawStamps; // Model stamp per pixel of target
+    QVector<int> lodLevels;          // Level of detail drawn per model
+
+    TileBinner binner;                      // Tile bins for the tiled mode
+    QVector<ScreenTriangle> screenTriangles; // Triangles referenced by bins
+    QVector<int> activeTiles;                // Tiles with work this frame
+    QVector<FrameStats> tileStats;           // Occlusion counters per tile
+
+    static constexpr uint32_t ClearColor = 0xffffffff; // Opaque white
+
+    // Relative margin on a triangle's nearest depth before it is compared
+    // against the depth pyramid. The kernels interpolate depth in float, so
+    // a fragment can land a few ulps in front of the nearest corner.
+    static constexpr float DepthMargin = 1e-4f;
+
+    // Levels the ideal level of detail must move past the current one's
+    // range before the model switches, about 10% in projected size
+    static constexpr float LodHysteresis = 0.15f;
+
+  public:
+    // Constructor
+    Renderer(Scene *scene, int width, int height)
+        : target(width, height), scene(scene) {
+        if (!scene) {
+            throw std::invalid_argument("Scene cannot be null.");
+        }
+        perspectiveProjection =
+            QVector3D(0, 0, 300); // Initialize perspective projection
+        clearTarget();
+    }
+
+    // Reset the color buffer to the background and the depth buffer to the
+    // far plane. The clear is lazy: tiles are cleared as they are drawn to,
+    // and the rest when the frame is resolved at the end of renderScene().
+    void clearTarget() {
+        if (target.isNull())
+            return;
+        target.clearLazily(ClearColor, RenderTarget::FarDepth,
+                           binner.tileSize());
+        depthPyramid.reset(target.width(), target.height(), binner.tileSize(),
+                           RenderTarget::FarDepth);
+    }
+
+    // Resize the buffers; their contents are undefined until the next frame
+    void resize(int width, int height) { target.resize(width, height); }
+
+    // Exchange the buffers with other, e.g. to hand a finished frame to the
+    // display while the next one is drawn into other's buffers
+    void swapTarget(RenderTarget &other) { std::swap(target, other); }
+
+    const RenderTarget &getTarget() const { return target; }
+
+    // Camera and projection of the last frame, e.g. for picking
+    const VertexStage &getVertexStage() const { return vertexStage; }
+
+    // Takes effect with the next renderScene() call. Culling and
+    // hierarchical Z only affect speed, never the image; overdraw counting
+    // is only done by the fixed-point kernel.
+    void setSettings(const Settings &newSettings) {
+        settings = newSettings;
+        if (!settings.overdrawCounting)
+            overdrawStamps = QVector<quint32>();
+    }
+
+    const Settings &getSettings() const { return settings; }
+
+    const FrameStats &getFrameStats() const { return frameStats; }
+
+    // Whole render target as a clip rectangle
+    QRect targetRect() const {
+        return QRect(0, 0, target.width(), target.height());
+    }
+
+    // Method to render a model whose vertices were already projected by the
+    // vertex stage. Every 3 indices form a triangle, colored by the entry of
+    // colors with its index shifted by colorOffset (see
+    // MeshData::offsetColor), and cull should only be set for meshes with
+    // MeshWinding::Outward.
+    void renderModel(const ScreenVertices &vertices,
+                     ArrayView<quint32> indices, ArrayView<quint32> colors,
+                     CullMode cull = CullMode::None, QRgb colorOffset = 0) {
+        if (!target.isNull()) {
+            screenTriangles.clear();
+            {
+                ProfileScope scope(Profiler::Clip);
+                assembleModel(vertices, indices, colors, colorOffset, cull);
+            }
+            ProfileScope scope(Profiler::Raster);
+            QRect clip = targetRect();
+            for (const ScreenTriangle &triangle : screenTriangles) {
+                drawTriangle(triangle, clip, frameStats);
+            }
+        } else {
+            qWarning() << "Render target is empty, cannot render model.";
+        }
+    }
+
+    float Dot(const QPointF &a, const QPointF &b) {
+        return a.x() * b.x() + a.y() * b.y();
+    }
+
+    QPointF Perpendicular(const QPointF &a) { return QPointF(-a.y(), a.x()); }
+
+    float SignedAreaOfTriangle(const QPointF &p, const QPointF &a,
+                               const QPointF &b) {
+        QPointF abPerpendicular = Perpendicular(b - a);
+        QPointF ap = p - a;
+        return Dot(ap, abPerpendicular) / 2;
+    }
+
+    bool isPointInTriangle(const QPointF &p, const QPointF &a, const QPointF &b,
+                           const QPointF &c) {
+        float sideAB = SignedAreaOfTriangle(p, a, b);
+        float sideBC = SignedAreaOfTriangle(p, b, c);
+        float sideCA = SignedAreaOfTriangle(p, c, a);
+        return sideAB >= 0 && sideBC >= 0 && sideCA >= 0;
+    }
+
+    bool isPointInTriangle3D(const QPointF &p, const QPointF &a,
+                             const QPointF &b, const QPointF &c, float &w1,
+                             float &w2, float &w3) {
+        float sideAB = SignedAreaOfTriangle(p, a, b);
+        float sideBC = SignedAreaOfTriangle(p, b, c);
+        float sideCA = SignedAreaOfTriangle(p, c, a);
+
+        float totalArea = sideAB + sideBC + sideCA;
+        float invAreaSum = 1.0f / totalArea;
+        w1 = sideBC * invAreaSum;
+        w2 = sideCA * invAreaSum;
+        w3 = sideAB * invAreaSum;
+        return sideAB >= 0 && sideBC >= 0 && sideCA >= 0 && totalArea > 0.0f;
+    }
+
+    // Fill kernels. Vertices are in pixels with view depth in z, as the
+    // vertex stage outputs them. The pipeline draws with
+    // fillTriangleScanLine, HalfSpaceRasterizer or FixedPointRasterizer (see
+    // FillKernel); fillTriangleWithDepth and fillTriangle test every pixel
+    // of the bounding box and only draw clockwise triangles. They are kept
+    // for comparison in benchmarks/kernels. The kernels draw into the
+    // buffers as they are; the pipeline prepares lazily cleared tiles first.
+
+    // Triangle filling with Z-buffer depth testing
+    void fillTriangleWithDepth(const QVector3D &p1, const QVector3D &p2,
+                               const QVector3D &p3, QRgb color) {
+        if (target.isNull()) {
+            qWarning() << "Target image is invalid in fillTriangleWithDepth";
+            return;
+        }
+
+        // Get bounding box of the triangle
+        int minX = std::max(0, (int)std::min({p1.x(), p2.x(), p3.x()}));
+        int maxX = std::min(target.width() - 1,
+                            (int)std::max({p1.x(), p2.x(), p3.x()}));
+        int minY = std::max(0, (int)std::min({p1.y(), p2.y(), p3.y()}));
+        int maxY = std::min(target.height() - 1,
+                            (int)std::max({p1.y(), p2.y(), p3.y()}));
+
+        // Check if bounding box is valid
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+
+        // Check each pixel in the bounding box, row by row so that the
+        // buffers are walked in memory order
+        for (int y = minY; y <= maxY; ++y) {
+            uint32_t *colorRow = target.colorScanLine(y);
+            float *depthRow = target.depthScanLine(y);
+            for (int x = minX; x <= maxX; ++x) {
+                QPointF p(x, y);
+
+                // Check if point is inside triangle
+                float w1, w2, w3;
+                if (isPointInTriangle3D(p, QPointF(p1.x(), p1.y()),
+                                        QPointF(p2.x(), p2.y()),
+                                        QPointF(p3.x(), p3.y()), w1, w2, w3)) {
+                    // Interpolate Z value using barycentric coordinates
+                    float z = w1 * p1.z() + w2 * p2.z() + w3 * p3.z();
+
+                    // Skip pixels behind the camera (negative Z values)
+                    if (z <= 0.0f)
+                        continue;
+
+                    // Z-buffer test: only draw if this pixel is closer (smaller
+                    // Z = closer)
+                    if (z >= depthRow[x])
+                        continue;
+
+                    depthRow[x] = z;
+                    colorRow[x] = color;
+                }
+            }
+        }
+    }
+
+    void fillTriangle(QVector3D p1, QVector3D p2, QVector3D p3, QRgb color) {
+        // Check if target is valid
+        if (target.isNull()) {
+            qWarning() << "Target image is invalid in fillTriangle";
+            return;
+        }
+
+        // Get bounding box of the triangle
+        int minX = std::max(0, (int)std::min({p1.x(), p2.x(), p3.x()}));
+        int maxX = std::min(target.width() - 1,
+                            (int)std::max({p1.x(), p2.x(), p3.x()}));
+        int minY = std::max(0, (int)std::min({p1.y(), p2.y(), p3.y()}));
+        int maxY = std::min(target.height() - 1,
+                            (int)std::max({p1.y(), p2.y(), p3.y()}));
+
+        // Check if bounding box is valid
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+
+        // Check each pixel in the bounding box
+        for (int y = minY; y <= maxY; ++y) {
+            uint32_t *colorRow = target.colorScanLine(y);
+            for (int x = minX; x <= maxX; ++x) {
+                QPointF p(x, y);
+                if (isPointInTriangle(p, QPointF(p1.x(), p1.y()),
+                                      QPointF(p2.x(), p2.y()),
+                                      QPointF(p3.x(), p3.y()))) {
+                    colorRow[x] = color;
+                }
+            }
+        }
+    }
+
+    // Scanline fill with depth testing. Only pixels inside the clip
+    // rectangle are touched; interpolation does not depend on the clip, so a
+    // triangle drawn in pieces (e.g. per tile) gives the same pixels as one
+    // drawn in full.
+    void fillTriangleScanLine(const QVector3D &v1, const QVector3D &v2,
+                              const QVector3D &v3, QRgb fillColor,
+                              const QRect &clip) {
+        if (target.isNull()) {
+            qWarning() << "Target image is invalid in fillTriangleScanLine";
+            return;
+        }
+
+        // Build edge table for triangle (all 3 edges)
+        struct Edge {
+            double x_start, y_start, z_start;
+            double dx_dy, dz_dy;
+            int ymin, ymax;
+
+            Edge() = default;
+
+            Edge(const QVector3D &p1, const QVector3D &p2) {
+                // Ensure p1 is the lower point (smaller y)
+                QVector3D lower = (p1.y() <= p2.y()) ? p1 : p2;
+                QVector3D upper = (p1.y() <= p2.y()) ? p2 : p1;
+
+                x_start = lower.x();
+                y_start = lower.y();
+                z_start = lower.z();
+                ymin = (int)ceil(lower.y());
+                ymax = (int)floor(upper.y());
+
+                double dy = upper.y() - lower.y();
+                if (dy != 0) {
+                    dx_dy = (upper.x() - lower.x()) / dy;
+                    dz_dy = (upper.z() - lower.z()) / dy;
+                } else {
+                    dx_dy = 0;
+                    dz_dy = 0;
+                }
+            }
+
+            // Sample the edge at row y. Rows are limited to [ymin, ymax], so
+            // the result always lies on the edge itself.
+            std::pair<double, double> getIntersection(int y) const {
+                double x = x_start + dx_dy * (y - y_start);
+                double z = z_start + dz_dy * (y - y_start);
+                return {x, z};
+            }
+        };
+
+        // Create all three edges of the triangle, on the stack
+        Edge edges[3];
+        int edgeCount = 0;
+
+        // Only add non-horizontal edges
+        if (abs(v1.y() - v2.y()) > 0.01) {
+            edges[edgeCount++] = Edge(v1, v2);
+        }
+        if (abs(v2.y() - v3.y()) > 0.01) {
+            edges[edgeCount++] = Edge(v2, v3);
+        }
+        if (abs(v3.y() - v1.y()) > 0.01) {
+            edges[edgeCount++] = Edge(v3, v1);
+        }
+
+        if (edgeCount == 0) {
+            return; // Degenerate or horizontal triangle
+        }
+
+        // Find Y range
+        int ymin = std::max(clip.top(),
+                            (int)ceil(std::min({v1.y(), v2.y(), v3.y()})));
+        int ymax = std::min(clip.bottom(),
+                            (int)floor(std::max({v1.y(), v2.y(), v3.y()})));
+
+        // Process each scanline
+        for (int y = ymin; y <= ymax; ++y) {
+            uint32_t *colorRow = target.colorScanLine(y);
+            float *depthRow = target.depthScanLine(y);
+
+            // A triangle covers a single span per scanline, bounded by the
+            // leftmost and rightmost edge intersections
+            int hits = 0;
+            std::pair<double, double> left, right; // x, z pairs
+            for (int e = 0; e < edgeCount; ++e) {
+                const Edge &edge = edges[e];
+                if (y >= edge.ymin && y <= edge.ymax) {
+                    auto intersection = edge.getIntersection(y);
+                    if (hits == 0 || intersection < left)
+                        left = intersection;
+                    if (hits == 0 || right < intersection)
+                        right = intersection;
+                    hits++;
+                }
+            }
+
+            if (hits < 2)
+                continue;
+
+            int x1 = (int)round(left.first);
+            int x2 = (int)round(right.first);
+            double z1 = left.second;
+            double z2 = right.second;
+
+            for (int x = std::max(clip.left(), x1);
+                 x <= std::min(clip.right(), x2); ++x) {
+                double t = (x2 == x1) ? 0.0 : (double)(x - x1) / (x2 - x1);
+                double z = z1 + t * (z2 - z1);
+
+                // Z-buffer test
+                if (z > 0.0 && z < depthRow[x]) {
+                    depthRow[x] = z;
+                    colorRow[x] = fillColor;
+                }
+            }
+        }
+    }
+
+  private:
+    // Fill a screen-space triangle with the selected kernel. Overdraw is
+    // counted into stats when enabled.
+    void fillWithKernel(const ScreenTriangle &triangle, const QRect &clip,
+                        FrameStats &stats) {
+        const QVector3D &p1 = triangle.p1, &p2 = triangle.p2,
+                        &p3 = triangle.p3;
+        target.prepare(scanLineBounds(p1, p2, p3) & clip);
+        switch (settings.fillKernel) {
+        case FillKernel::ScanLine:
+            fillTriangleScanLine(p1, p2, p3, triangle.color, clip);
+            break;
+        case FillKernel::HalfSpace:
+            HalfSpaceRasterizer::fillTriangle(target, p1, p2, p3,
+                                              triangle.color, clip);
+            break;
+        case FillKernel::FixedPoint:
+            if (settings.overdrawCounting) {
+                OverdrawCounter counter;
+                counter.stamps = overdrawStamps.data();
+                counter.stamp = quint32(triangle.model + 1);
+                FixedPointRasterizer::fillTriangle(
+                    target, p1, p2, p3, triangle.color, clip, &counter);
+                stats.fragmentsCovered += counter.covered;
+                stats.doubleWrites += counter.doubled;
+            } else {
+                FixedPointRasterizer::fillTriangle(target, p1, p2, p3,
+                                                   triangle.color, clip);
+            }
+            break;
+        }
+    }
+
+    // Fill a screen-space triangle, leaving out the blocks of the clip
+    // rectangle where the depth pyramid shows it to be hidden. Both kernels
+    // give the same pixels no matter how the clip rectangle is cut, so the
+    // visible blocks are drawn as horizontal runs, one band of blocks at a
+    // time. Occlusion counters go to stats.
+    void drawTriangle(const ScreenTriangle &triangle, const QRect &clip,
+                      FrameStats &stats) {
+        if (!settings.hierarchicalZ) {
+            fillWithKernel(triangle, clip, stats);
+            return;
+        }
+        const QVector3D &p1 = triangle.p1, &p2 = triangle.p2,
+                        &p3 = triangle.p3;
+        QRect area = scanLineBounds(p1, p2, p3) & clip;
+        if (area.isEmpty())
+            return;
+
+        // Depth is linear over the triangle, so no fragment is nearer than
+        // its nearest corner
+        float nearest =
+            std::min({p1.z(), p2.z(), p3.z()}) * (1.0f - DepthMargin);
+        if (depthPyramid.isTileOccluded(area, nearest)) {
+            stats.trianglesOccluded++;
+            stats.fragmentsSkipped += qint64(area.width()) * area.height();
+            return;
+        }
+        if (depthPyramid.isInFront(area, nearest)) {
+            fillWithKernel(triangle, area, stats);
+            depthPyramid.markWritten(area, nearest);
+            return;
+        }
+
+        const int block = DepthPyramid::BlockSize;
+        int firstColumn = area.left() / block;
+        int lastColumn = area.right() / block;
+        int firstRow = area.top() / block;
+        int lastRow = area.bottom() / block;
+        auto isHidden = [&](int column, int row) {
+            return depthPyramid.isBlockOccluded(target, column, row, nearest);
+        };
+        int hidden = 0;
+        for (int by = firstRow; by <= lastRow; ++by) {
+            for (int bx = firstColumn; bx <= lastColumn; ++bx) {
+                hidden += isHidden(bx, by);
+            }
+        }
+        if (hidden == 0) {
+            fillWithKernel(triangle, area, stats);
+            depthPyramid.markWritten(area, nearest);
+            return;
+        }
+        if (hidden == (lastColumn - firstColumn + 1) * (lastRow - firstRow + 1))
+            stats.trianglesOccluded++;
+
+        for (int by = firstRow; by <= lastRow; ++by) {
+            QRect band = area & QRect(0, by * block, target.width(), block);
+            for (int bx = firstColumn; bx <= lastColumn;) {
+                bool hiddenRun = isHidden(bx, by);
+                int end = bx + 1;
+                while (end <= lastColumn && isHidden(end, by) == hiddenRun)
+                    ++end;
+                QRect run = band & QRect(bx * block, band.top(),
+                                         (end - bx) * block, band.height());
+                if (hiddenRun) {
+                    stats.fragmentsSkipped +=
+                        qint64(run.width()) * run.height();
+                } else {
+                    fillWithKernel(triangle, run, stats);
+                    depthPyramid.markWritten(run, nearest);
+                }
+                bx = end;
+            }
+        }
+    }
+
+    // Pass a projected triangle on to output unless it is culled. It is cut
+    // into a fan of up to 6 triangles if it crosses the near plane or leaves
+    // the guard band; most triangles need no clipping and are passed on
+    // unchanged.
+    template <typename Output>
+    void assembleTriangle(const QVector3D &p1, const QVector3D &p2,
+                          const QVector3D &p3, CullMode cull, Output output) {
+        if (Clipper::isInside(p1, p2, p3, VertexStage::NearPlane)) {
+            if (isCulled(p1, p2, p3, cull)) {
+                frameStats.trianglesCulled++;
+                return;
+            }
+            frameStats.trianglesDrawn++;
+            output(p1, p2, p3);
+            return;
+        }
+
+        // Clipping keeps the winding, so the culling decision can be made on
+        // the first triangle of the fan with a usable area
+        frameStats.trianglesClipped++;
+        QVector3D polygon[Clipper::MaxVertices];
+        int count =
+            Clipper::clip(p1, p2, p3, VertexStage::NearPlane, polygon);
+        for (int k = 1; k + 1 < count && cull != CullMode::None; ++k) {
+            if (SignedAreaOfTriangle(polygon[k + 1].toPointF(),
+                                     polygon[0].toPointF(),
+                                     polygon[k].toPointF()) == 0)
+                continue;
+            if (isCulled(polygon[0], polygon[k], polygon[k + 1], cull)) {
+                frameStats.trianglesCulled++;
+                return;
+            }
+            break;
+        }
+        for (int k = 1; k + 1 < count; ++k) {
+            frameStats.trianglesDrawn++;
+            output(polygon[0], polygon[k], polygon[k + 1]);
+        }
+    }
+
+    // Screen y points down, so triangles that are counter-clockwise seen
+    // from outside the mesh have a positive signed area when they face the
+    // camera
+    bool isCulled(const QVector3D &p1, const QVector3D &p2,
+                  const QVector3D &p3, CullMode cull) {
+        if (cull == CullMode::None)
+            return false;
+        float area = SignedAreaOfTriangle(p3.toPointF(), p1.toPointF(),
+                                          p2.toPointF());
+        return cull == CullMode::Back ? area < 0 : area > 0;
+    }
+
+    // Inclusive pixel bounds of everything the fill kernels can write for a
+    // triangle. fillTriangleScanLine rounds span ends to the nearest pixel,
+    // and the fixed-point kernel snaps vertices by up to 1/32 pixel, which
+    // can reach the row above or below the triangle's float bounds.
+    static QRect scanLineBounds(const QVector3D &p1, const QVector3D &p2,
+                                const QVector3D &p3) {
+        int minX = (int)round(std::min({p1.x(), p2.x(), p3.x()}));
+        int maxX = (int)round(std::max({p1.x(), p2.x(), p3.x()}));
+        int minY = (int)floor(std::min({p1.y(), p2.y(), p3.y()}));
+        int maxY = (int)ceil(std::max({p1.y(), p2.y(), p3.y()}));
+        return QRect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+    }
+
+    // Append the triangles of a projected model that survive culling and
+    // clipping to screenTriangles
+    void assembleModel(const ScreenVertices &vertices,
+                       ArrayView<quint32> indices, ArrayView<quint32> colors,
+                       QRgb colorOffset, CullMode cull) {
+        for (int i = 0; i + 2 < indices.size(); i += 3) {
+            QRgb color = MeshData::offsetColor(colors[i / 3], colorOffset);
+            assembleTriangle(vertices.at(indices[i]),
+                             vertices.at(indices[i + 1]),
+                             vertices.at(indices[i + 2]), cull,
+                             [&](const QVector3D &a, const QVector3D &b,
+                                 const QVector3D &c) {
+                                 screenTriangles.append(
+                                     {a, b, c, color, currentModel});
+                             });
+        }
+    }
+
+    // Add a projected model's triangles to the tile bins; they are drawn
+    // later by renderTiles
+    void binModel(const ScreenVertices &vertices,
+                  ArrayView<quint32> indices, ArrayView<quint32> colors,
+                  QRgb colorOffset, CullMode cull) {
+        int first = screenTriangles.size();
+        {
+            ProfileScope scope(Profiler::Clip);
+            assembleModel(vertices, indices, colors, colorOffset, cull);
+        }
+        ProfileScope scope(Profiler::Bin);
+        for (int index = first; index < screenTriangles.size(); ++index) {
+            const ScreenTriangle &triangle = screenTriangles[index];
+            QRect bounds =
+                scanLineBounds(triangle.p1, triangle.p2, triangle.p3);
+            binner.insert(index, bounds.left(), bounds.top(), bounds.right(),
+                          bounds.bottom());
+        }
+    }
+
+    // Rasterize all non-empty tiles on the global thread pool. Tiles do not
+    // overlap, so each worker owns the color and depth of the tile it draws.
+    void renderTiles() {
+        activeTiles.clear();
+        for (int tile = 0; tile < binner.tileCount(); ++tile) {
+            if (!binner.bin(tile).isEmpty())
+                activeTiles.append(tile);
+        }
+
+        tileStats.fill(FrameStats(), binner.tileCount());
+        QtConcurrent::blockingMap(activeTiles, [this](const int &tile) {
+            ProfileScope scope(Profiler::Raster);
+            QRect clip = binner.tileRect(tile);
+            FrameStats &stats = tileStats[tile];
+            for (int index : binner.bin(tile)) {
+                drawTriangle(screenTriangles[index], clip, stats);
+            }
+        });
+        for (int tile : activeTiles) {
+            frameStats.trianglesOccluded += tileStats[tile].trianglesOccluded;
+            frameStats.fragmentsSkipped += tileStats[tile].fragmentsSkipped;
+            frameStats.fragmentsCovered += tileStats[tile].fragmentsCovered;
+            frameStats.doubleWrites += tileStats[tile].doubleWrites;
+        }
+    }
+
+    // Side of a scene model to cull. A mirroring transform turns front faces
+    // into back faces.
+    CullMode cullModeFor(int index) const {
+        if (settings.cullMode == CullMode::None ||
+            scene->getModels()[index].getWinding() != MeshWinding::Outward)
+            return CullMode::None;
+        if (scene->isMirrored(index))
+            return settings.cullMode == CullMode::Back ? CullMode::Front
+                                              : CullMode::Back;
+        return settings.cullMode;
+    }
+
+    // Level of detail to draw a model with. The ideal level rises by one
+    // each time the projected radius halves below Settings::lodRadius, and
+    // the level drawn last frame is kept until the ideal one has moved
+    // LodHysteresis past its range, so models near a threshold do not pop
+    // back and forth between two levels. Occluders are always drawn at level
+    // 0, the mesh the occlusion pass tested the other models against.
+    int selectLod(int index) {
+        int &level = lodLevels[index];
+        int count = scene->getModels()[index].getLodCount();
+        if (!settings.levelOfDetail || count == 1 || scene->isOccluder(index)) {
+            level = 0;
+            return level;
+        }
+        float radius =
+            vertexStage.projectedRadius(scene->getWorldSphere(index));
+        float ideal = std::log2(settings.lodRadius / radius) + 1;
+        if (ideal < level - LodHysteresis || ideal > level + 1 + LodHysteresis)
+            level = int(std::floor(std::clamp(ideal, 0.0f, count - 1.0f)));
+        level = std::min(level, count - 1);
+        return level;
+    }
+
+    // Draw the visible occluders into the occlusion buffer and drop the
+    // models they hide from visibleModels. Occluders are drawn with the
+    // frame's cull mode so they cover no more than they will in the frame.
+    // Triangles crossing the near plane are left out.
+    void cullOccludedModels() {
+        occlusionBuffer.begin(target.width(), target.height());
+        const QVector<Model> &models = scene->getModels();
+        for (int index : visibleModels) {
+            if (!scene->isOccluder(index))
+                continue;
+            const Model &model = models[index];
+            ArrayView<QVector3D> vertices = model.getVertices();
+            ArrayView<quint32> indices = model.getIndices();
+            vertexStage.setModelMatrix(scene->getModelTransform(index));
+            vertexStage.transform(vertices.constData(), vertices.size(),
+                                  screenVertices);
+            CullMode cull = cullModeFor(index);
+            for (int i = 0; i + 2 < indices.size(); i += 3) {
+                QVector3D p1 = screenVertices.at(indices[i]);
+                QVector3D p2 = screenVertices.at(indices[i + 1]);
+                QVector3D p3 = screenVertices.at(indices[i + 2]);
+                if (Clipper::isInside(p1, p2, p3, VertexStage::NearPlane) &&
+                    !isCulled(p1, p2, p3, cull))
+                    occlusionBuffer.addTriangle(p1, p2, p3);
+            }
+        }
+        if (occlusionBuffer.isEmpty())
+            return;
+
+        int kept = 0;
+        for (int index : visibleModels) {
+            QRectF rect;
+            float nearest;
+            if (!scene->isOccluder(index) &&
+                vertexStage.screenBounds(scene->getWorldBounds(index), rect,
+                                         nearest) &&
+                occlusionBuffer.isOccluded(rect, nearest)) {
+                frameStats.modelsOccluded++;
+                continue;
+            }
+            visibleModels[kept++] = index;
+        }
+        visibleModels.resize(kept);
+    }
+
+    // Project a single world-space point with the current frame's camera
+    QVector3D PointToScreen(const QVector3D &point) {
+        if (target.isNull()) {
+            qWarning() << "Target image is invalid in PointToScreen";
+            return QVector3D(0, 0, 0);
+        }
+        return vertexStage.project(point);
+    }
+
+  public:
+    // Draw the scene as seen by camera into the render target
+    void renderScene(const Camera &camera) {
+        if (target.isNull()) {
+            qWarning() << "Render target is empty, cannot render.";
+            return;
+        }
+        ProfileScope frame(Profiler::Frame);
+        {
+            ProfileScope scope(Profiler::Clear);
+            clearTarget();
+        }
+        vertexStage.begin(camera, perspectiveProjection, target.width(),
+                          target.height());
+        if (settings.renderMode == RenderMode::Tiled) {
+            binner.reset(target.width(), target.height());
+            screenTriangles.clear();
+        }
+
+        frameStats = FrameStats();
+        if (lodLevels.size() != scene->getModels().size())
+            lodLevels.fill(0, scene->getModels().size());
+        if (settings.overdrawCounting)
+            overdrawStamps.fill(0, target.stride() * target.height());
+        Frustum frustum = vertexStage.frustum();
+
+        // Models to draw, in scene order so that depth ties resolve the same
+        // way with and without culling
+        const QVector<Model> &models = scene->getModels();
+        ProfileScope cullScope(Profiler::Cull);
+        visibleModels.clear();
+        if (settings.frustumCulling) {
+            scene->getBvh().cull(frustum, [this](int index) {
+                visibleModels.append(index);
+            });
+            std::sort(visibleModels.begin(), visibleModels.end());
+        } else {
+            for (int index = 0; index < models.size(); ++index) {
+                visibleModels.append(index);
+            }
+        }
+        frameStats.modelsCulled = models.size() - visibleModels.size();
+        if (settings.occlusionCulling && scene->getOccluderCount() > 0)
+            cullOccludedModels();
+        frameStats.modelsDrawn = visibleModels.size();
+        cullScope.finish();
+
+        for (int index : visibleModels) {
+            const Model &model = models[index];
+            const QMatrix4x4 &transform = scene->getModelTransform(index);
+
+            // Project every unique vertex of the model once, then rasterize
+            // the triangles that share them
+            const MeshData &mesh = model.getLod(selectLod(index));
+            frameStats.trianglesSaved +=
+                model.getTriangleCount() - mesh.indices().size() / 3;
+            ArrayView<QVector3D> vertices = mesh.vertices();
+            {
+                ProfileScope scope(Profiler::Transform);
+                vertexStage.setModelMatrix(transform);
+                vertexStage.transform(vertices.constData(), vertices.size(),
+                                      screenVertices);
+            }
+
+            // Colors come straight from the mesh, shifted to continue the
+            // palette from the triangles of earlier models
+            CullMode cull = cullModeFor(index);
+            QRgb colorOffset = scene->getColorOffset(index);
+            currentModel = index;
+            if (settings.renderMode == RenderMode::Tiled) {
+                binModel(screenVertices, mesh.indices(), mesh.colors(),
+                         colorOffset, cull);
+            } else {
+                renderModel(screenVertices, mesh.indices(), mesh.colors(), cull,
+                            colorOffset);
+            }
+        }
+
+        if (settings.renderMode == RenderMode::Tiled) {
+            renderTiles();
+        }
+
+        ProfileScope scope(Profiler::Resolve);
+        target.resolve();
+    }
+};
+
+#endif // RENDERER_H
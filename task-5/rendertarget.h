@@ -0,0 +1,210 @@
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+#include "qimage.h"
+#include "qrect.h"
+#include <QVector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+
+// RenderTarget owns the color and depth buffers the rasterizer draws into.
+// Each buffer is a single aligned allocation with the same row stride, so the
+// fragment at (x, y) lives at index y * stride() + x in both of them. Colors
+// are stored as packed 0xAARRGGBB values, which is the QImage::Format_ARGB32
+// layout, so presenting the frame does not need any conversion.
+//
+// A frame can also be cleared lazily, tile by tile. clearLazily() only
+// starts a new generation; a tile's buffers are cleared when prepare() is
+// first called on it in that generation, while the tile is about to be drawn
+// and in cache anyway. resolve() clears the color of the tiles nothing was
+// drawn to. Their depth is never read, so it is left alone, and a tile that
+// still holds only the clear color from an earlier frame is skipped.
+class RenderTarget {
+  public:
+    static constexpr std::size_t Alignment = 64; // Cache line size in bytes
+    static constexpr float FarDepth = std::numeric_limits<float>::max();
+
+    RenderTarget() = default;
+
+    RenderTarget(int width, int height) { resize(width, height); }
+
+    // Reallocate both buffers. Contents are undefined until the next clear.
+    void resize(int width, int height) {
+        if (width <= 0 || height <= 0) {
+            w = h = rowStride = tiles = 0;
+            color.reset();
+            depth.reset();
+            return;
+        }
+        if (width == w && height == h)
+            return;
+        tiles = 0; // Set up again by the next clearLazily()
+
+        // Pad every row to a whole number of cache lines
+        const int elementsPerLine = Alignment / sizeof(uint32_t);
+        w = width;
+        h = height;
+        rowStride = (width + elementsPerLine - 1) / elementsPerLine *
+                    elementsPerLine;
+
+        std::size_t count = std::size_t(rowStride) * h;
+        color.reset(allocate<uint32_t>(count));
+        depth.reset(allocate<float>(count));
+    }
+
+    // Fill the whole color buffer with one color and the depth buffer with
+    // the far value
+    void clear(uint32_t clearColor, float clearDepth = FarDepth) {
+        std::size_t count = std::size_t(rowStride) * h;
+        std::fill_n(color.get(), count, clearColor);
+        std::fill_n(depth.get(), count, clearDepth);
+
+        // Tiles are cleared, but may be drawn to without prepare()
+        generation++;
+        prepared.fill(generation);
+        colorCleared.fill(generation);
+        clean.fill(0);
+    }
+
+    // Start a frame cleared to clearColor and clearDepth without touching
+    // the buffers. Tiles are tileSize pixels square.
+    void clearLazily(uint32_t clearColor, float clearDepth, int tileSize) {
+        if (tiles == 0 || tileSize != tileSide) {
+            tileSide = std::max(1, tileSize);
+            tileColumns = (w + tileSide - 1) / tileSide;
+            tiles = tileColumns * ((h + tileSide - 1) / tileSide);
+            prepared.fill(0, tiles);
+            colorCleared.fill(0, tiles);
+            clean.fill(0, tiles);
+            generation = 0;
+        }
+        if (clearColor != lazyColor) {
+            lazyColor = clearColor;
+            clean.fill(0);
+        }
+        lazyDepth = clearDepth;
+        generation++;
+    }
+
+    // Clear the tiles under rect that were not cleared since the last
+    // clearLazily(), before drawing into rect. Tiles are independent, so
+    // threads may prepare and draw disjoint tiles at the same time.
+    void prepare(const QRect &rect) {
+        if (tiles == 0)
+            return;
+        int left = std::max(0, rect.left()) / tileSide;
+        int right = std::min(w - 1, rect.right()) / tileSide;
+        int top = std::max(0, rect.top()) / tileSide;
+        int bottom = std::min(h - 1, rect.bottom()) / tileSide;
+        for (int ty = top; ty <= bottom; ++ty) {
+            for (int tx = left; tx <= right; ++tx) {
+                int tile = ty * tileColumns + tx;
+                if (prepared[tile] != generation)
+                    prepareTile(tile);
+            }
+        }
+    }
+
+    // Clear the color of every tile that was not prepared since the last
+    // clearLazily(), so the whole color buffer shows the frame
+    void resolve() {
+        for (int tile = 0; tile < tiles; ++tile) {
+            if (colorCleared[tile] == generation)
+                continue;
+            if (!clean[tile])
+                fillTile(color.get(), tile, lazyColor);
+            colorCleared[tile] = generation;
+            clean[tile] = 1;
+        }
+    }
+
+    int width() const { return w; }
+
+    int height() const { return h; }
+
+    // Distance between two rows in elements (not bytes)
+    int stride() const { return rowStride; }
+
+    bool isNull() const { return w == 0 || h == 0; }
+
+    uint32_t *colorScanLine(int y) {
+        return color.get() + std::size_t(y) * rowStride;
+    }
+
+    const uint32_t *colorScanLine(int y) const {
+        return color.get() + std::size_t(y) * rowStride;
+    }
+
+    float *depthScanLine(int y) {
+        return depth.get() + std::size_t(y) * rowStride;
+    }
+
+    const float *depthScanLine(int y) const {
+        return depth.get() + std::size_t(y) * rowStride;
+    }
+
+    // Wrap the color buffer in a QImage without copying it. The image is
+    // only valid until the next resize of this target, and after a lazy
+    // clear only shows the frame once it is resolved.
+    QImage toImage() const {
+        if (isNull())
+            return QImage();
+        return QImage(reinterpret_cast<const uchar *>(color.get()), w, h,
+                      qsizetype(rowStride) * sizeof(uint32_t),
+                      QImage::Format_ARGB32);
+    }
+
+  private:
+    struct AlignedDeleter {
+        void operator()(void *p) const {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+    };
+
+    template <typename T> static T *allocate(std::size_t count) {
+        return static_cast<T *>(
+            ::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    int w = 0;
+    int h = 0;
+    int rowStride = 0;
+    std::unique_ptr<uint32_t[], AlignedDeleter> color;
+    std::unique_ptr<float[], AlignedDeleter> depth;
+
+    // Lazy clear state, one entry per tile in row-major order
+    int tileSide = 0;
+    int tileColumns = 0;
+    int tiles = 0;           // 0 until the first clearLazily()
+    quint32 generation = 0;  // Counts clears
+    uint32_t lazyColor = 0;  // Values of the last clearLazily()
+    float lazyDepth = FarDepth;
+    QVector<quint32> prepared;     // Generation of the last prepare
+    QVector<quint32> colorCleared; // Generation of the last color clear
+    QVector<uchar> clean;          // Color is all lazyColor
+
+    void prepareTile(int tile) {
+        fillTile(depth.get(), tile, lazyDepth);
+        if (colorCleared[tile] != generation && !clean[tile])
+            fillTile(color.get(), tile, lazyColor);
+        colorCleared[tile] = generation;
+        clean[tile] = 0; // About to be drawn to
+        prepared[tile] = generation;
+    }
+
+    template <typename T> void fillTile(T *buffer, int tile, T value) {
+        int x = tile % tileColumns * tileSide;
+        int y = tile / tileColumns * tileSide;
+        int width = std::min(tileSide, w - x);
+        int bottom = std::min(h, y + tileSide);
+        for (; y < bottom; ++y) {
+            std::fill_n(buffer + std::size_t(y) * rowStride + x, width, value);
+        }
+    }
+};
+
+#endif // RENDERTARGET_H
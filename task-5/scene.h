@@ -1,73 +1,216 @@
 #ifndef SCENE_H
 #define SCENE_H
+#include "bvh.h"
 #include "camera.h"
+#include "meshcache.h"
 #include "model.h"
+#include "objloader.h"
 #include "qcolor.h"
 #include "qevent.h"
-#include "qfile.h"
+#include "qmatrix4x4.h"
 #include "qvectornd.h"
+#include <QHash>
 
 // Scene class stores objects, and camera
+//
+// Every entry of the scene is an instance: a Model, whose mesh buffers may be
+// shared with other entries, placed by its own transform and shifted by its
+// own color offset. Placing an object again with addInstance() or loading a
+// file again only adds the per-instance state, so memory grows with the
+// number of unique meshes rather than with the number of placed objects.
 class Scene {
     QVector<Model> models; // List of models in the scene
     Camera *camera;
 
+    // First model read from each file so far, by path. New instances copy
+    // it, so they share its levels of detail too.
+    QHash<QString, int> loadedModels;
+
+    QVector<QMatrix4x4> transforms;       // Model to world, per model
+    QVector<bool> mirrored;               // Transform flips the winding
+    QVector<Aabb> worldBounds;            // Model bounds in world space
+    QVector<BoundingSphere> worldSpheres; // Model spheres in world space
+    QVector<qint64> triangleOffsets;      // Triangles in earlier models
+    QVector<QRgb> colorOffsets;           // Palette offset of each model
+    QVector<bool> occluders;              // Drawn in the occlusion pass
+    int occluderCount = 0;
+    SceneBvh bvh;                         // Over worldBounds
+    bool bvhValid = false;                // Rebuilt when models are added
+
   public:
     Scene() { camera = new Camera(M_PI / 3); };
 
     ~Scene() { delete camera; }
 
-    void addModel(const Model &model) { models.append(model); }
+    // Add a model placed by transform and return its index. Its colors
+    // continue the palette after the triangles of all earlier models.
+    int addModel(const Model &model,
+                 const QMatrix4x4 &transform = QMatrix4x4()) {
+        triangleOffsets.append(models.isEmpty()
+                                   ? 0
+                                   : triangleOffsets.last() +
+                                         models.last().getTriangleCount());
+        models.append(model);
+        colorOffsets.append(MeshData::paletteOffset(triangleOffsets.last()));
+        transforms.append(transform);
+        mirrored.append(transform.determinant() < 0);
+        worldBounds.append(model.getBounds().transformed(transform));
+        worldSpheres.append(model.getBoundingSphere().transformed(transform));
+        occluders.append(false);
+        bvhValid = false;
+        return models.size() - 1;
+    }
+
+    // Place the mesh of model index once more, sharing its buffers, and
+    // return the index of the new instance
+    int addInstance(int index, const QMatrix4x4 &transform) {
+        Model model = models[index]; // models may grow below
+        return addModel(model, transform);
+    }
+
+    // Space for count models in total, before adding many instances
+    void reserve(int count) {
+        models.reserve(count);
+        transforms.reserve(count);
+        mirrored.reserve(count);
+        worldBounds.reserve(count);
+        worldSpheres.reserve(count);
+        triangleOffsets.reserve(count);
+        colorOffsets.reserve(count);
+        occluders.reserve(count);
+    }
+
+    // Give every model up to levels levels of detail, see Model::buildLods.
+    // Each mesh is simplified once and its instances share the result.
+    void buildLods(int levels) {
+        QHash<const MeshData *, int> built; // First model of each mesh
+        for (int index = 0; index < models.size(); ++index) {
+            const MeshData *mesh = models[index].getMesh().get();
+            if (built.contains(mesh)) {
+                models[index] = models[built.value(mesh)];
+            } else {
+                models[index].buildLods(levels);
+                built.insert(mesh, index);
+            }
+        }
+    }
+
+    // Use a model to hide others in the occlusion pass. Good occluders are
+    // large, closed and have few triangles.
+    void setOccluder(int index, bool occluder) {
+        if (occluders[index] != occluder)
+            occluderCount += occluder ? 1 : -1;
+        occluders[index] = occluder;
+    }
+
+    bool isOccluder(int index) const { return occluders[index]; }
+
+    int getOccluderCount() const { return occluderCount; }
+
+    // Move a model. Only the model's path in the BVH is refit.
+    void setModelTransform(int index, const QMatrix4x4 &transform) {
+        transforms[index] = transform;
+        mirrored[index] = transform.determinant() < 0;
+        worldBounds[index] = models[index].getBounds().transformed(transform);
+        worldSpheres[index] =
+            models[index].getBoundingSphere().transformed(transform);
+        if (bvhValid)
+            bvh.refit(index, worldBounds[index]);
+    }
+
+    const QMatrix4x4 &getModelTransform(int index) const {
+        return transforms[index];
+    }
+
+    // True if the model's transform mirrors it, which turns its front faces
+    // into back faces
+    bool isMirrored(int index) const { return mirrored[index]; }
+
+    const Aabb &getWorldBounds(int index) const { return worldBounds[index]; }
+
+    const BoundingSphere &getWorldSphere(int index) const {
+        return worldSpheres[index];
+    }
+
+    // Triangles in all models before this one, the model's palette offset
+    qint64 getTriangleOffset(int index) const {
+        return triangleOffsets[index];
+    }
+
+    // Offset of the model's triangle colors, see MeshData::offsetColor. It
+    // continues the palette from the triangles of earlier models.
+    QRgb getColorOffset(int index) const { return colorOffsets[index]; }
+
+    void setColorOffset(int index, QRgb offset) {
+        colorOffsets[index] = offset;
+    }
+
+    // Hierarchy over the world bounds of all models
+    const SceneBvh &getBvh() {
+        if (!bvhValid) {
+            bvh.build(worldBounds);
+            bvhValid = true;
+        }
+        return bvh;
+    }
+
+    // Closest model hit by the ray origin + t * direction with t > 0, or
+    // -1. distance receives t of the hit.
+    int pick(const QVector3D &origin, const QVector3D &direction,
+             float *distance = nullptr) {
+        float closest = std::numeric_limits<float>::max();
+        int hit = getBvh().raycast(
+            origin, direction, closest, [&](int index, float &t) {
+                return intersectModel(index, origin, direction, t);
+            });
+        if (distance)
+            *distance = closest;
+        return hit;
+    }
 
+    // Add the model in an OBJ file. A file read before is not read again;
+    // the new model is an instance of the first one read from it, sharing
+    // its mesh and levels of detail.
     void readFromObjFile(const QString &filePath) {
+        if (loadedModels.contains(filePath)) {
+            addInstance(loadedModels.value(filePath), QMatrix4x4());
+            return;
+        }
         qDebug() << "Reading OBJ file from path:" << filePath;
-        // Open the file
-        QFile file = QFile(filePath);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            qDebug() << "Could not open file:" << filePath;
+        std::shared_ptr<const MeshData> cached = MeshCache::load(filePath);
+        if (cached) {
+            Model model(cached);
+            loadedModels.insert(filePath, addModel(model));
+            qDebug() << "Loaded model with" << model.getVertexCount()
+                     << "vertices and" << model.getTriangleCount()
+                     << "triangles from cache:"
+                     << MeshCache::cachePath(filePath);
             return;
         }
-        QTextStream in(&file);
-
-        QVector<QVector3D> points;
-        QVector<QVector3D> trianglePoints;
-
-        while (!in.atEnd()) {
-            QString line = in.readLine();
-            if (line.startsWith("v ")) { // Vertex
-                QStringList parts = line.split(' ');
-                if (parts.size() == 4) {
-                    float x = parts[1].toFloat();
-                    float y = parts[2].toFloat();
-                    float z = parts[3].toFloat();
-                    points.append(QVector3D(x, y, z));
-                }
-            } else if (line.startsWith("f ")) { // Face
-                QStringList parts = line.split(' ');
-                // I know that OBJ files can have faces with different numbers
-                // of vertices, but for simplicity, I assume triangular faces.
-                if (parts.size() == 4) {
-                    for (int i = 1; i < 4; ++i) {
-                        QStringList secondParts = parts[i].split('/');
-                        if (secondParts.size() >= 1) {
-                            int index = secondParts[0].toInt() -
-                                        1; // OBJ indices are 1-based
-                            trianglePoints.append(points[index]);
-                        }
-                    }
-                }
-            }
+
+        ObjMesh mesh;
+        if (!ObjLoader::load(filePath, mesh)) {
+            return;
+        }
+
+        if (mesh.skippedFaces > 0) {
+            qDebug() << "Skipped" << mesh.skippedFaces
+                     << "faces with invalid indices in" << filePath;
+        }
+        if (mesh.malformedVertices > 0) {
+            qDebug() << "Found" << mesh.malformedVertices
+                     << "malformed vertices in" << filePath;
         }
 
-        file.close();
-        if (!trianglePoints.isEmpty()) {
-            Model model(trianglePoints);
-            addModel(model);
-            qDebug() << "Loaded model with" << trianglePoints.size()
-                     << "triangle points from file:" << filePath;
+        if (!mesh.indices.isEmpty()) {
+            Model model(mesh.vertices, mesh.indices);
+            loadedModels.insert(filePath, addModel(model));
+            MeshCache::store(filePath, *model.getMesh());
+            qDebug() << "Loaded model with" << model.getVertexCount()
+                     << "vertices and" << model.getTriangleCount()
+                     << "triangles from file:" << filePath;
         } else {
-            qDebug() << "No valid triangle points found in the file:"
-                     << filePath;
+            qDebug() << "No valid triangles found in the file:" << filePath;
         }
     }
 
@@ -76,23 +219,61 @@ class Scene {
 
     Camera *getCamera() { return camera; }
 
+    // Color of every triangle in the scene, in model order
     QVector<QColor> getColors() const {
-        // Count number of triangles in all models
-        int triangleCount = 0;
-        for (const Model &model : models) {
-            triangleCount += model.getTrianglePoints().size() /
-                             3; // Each triangle has 3 points
-        }
-        // Generate distinct colors based on the number of triangles
         QVector<QColor> colors;
-        for (int i = 0; i < triangleCount; ++i) {
-            int r = (i * 123 + 45) % 256; // Simple color generation logic
-            int g = (i * 234 + 67) % 256;
-            int b = (i * 345 + 89) % 256;
-            colors.append(QColor(r, g, b));
+        for (int index = 0; index < models.size(); ++index) {
+            for (quint32 color : models[index].getColors()) {
+                colors.append(QColor(
+                    MeshData::offsetColor(color, colorOffsets[index])));
+            }
         }
         return colors;
     }
+
+  private:
+    // Moller-Trumbore against every triangle of a model, in model space.
+    // An affine transform keeps the ray parameter, so t is the same in both
+    // spaces. Lowers t and returns true on a hit closer than t.
+    bool intersectModel(int index, const QVector3D &worldOrigin,
+                        const QVector3D &worldDirection, float &t) const {
+        const QMatrix4x4 &transform = transforms[index];
+        bool invertible = true;
+        QMatrix4x4 inverse = transform.inverted(&invertible);
+        if (!invertible)
+            return false;
+        QVector3D origin = inverse.map(worldOrigin);
+        QVector3D direction = inverse.mapVector(worldDirection);
+
+        const Model &model = models[index];
+        ArrayView<QVector3D> vertices = model.getVertices();
+        ArrayView<quint32> indices = model.getIndices();
+        bool found = false;
+        for (int i = 0; i + 2 < indices.size(); i += 3) {
+            const QVector3D &a = vertices[indices[i]];
+            QVector3D ab = vertices[indices[i + 1]] - a;
+            QVector3D ac = vertices[indices[i + 2]] - a;
+            QVector3D p = QVector3D::crossProduct(direction, ac);
+            float determinant = QVector3D::dotProduct(ab, p);
+            if (determinant == 0)
+                continue;
+            float inverseDeterminant = 1.0f / determinant;
+            QVector3D s = origin - a;
+            float u = QVector3D::dotProduct(s, p) * inverseDeterminant;
+            if (u < 0 || u > 1)
+                continue;
+            QVector3D q = QVector3D::crossProduct(s, ab);
+            float v = QVector3D::dotProduct(direction, q) * inverseDeterminant;
+            if (v < 0 || u + v > 1)
+                continue;
+            float distance = QVector3D::dotProduct(ac, q) * inverseDeterminant;
+            if (distance > 0 && distance < t) {
+                t = distance;
+                found = true;
+            }
+        }
+        return found;
+    }
 };
 
 #endif // SCENE_H
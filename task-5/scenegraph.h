@@ -0,0 +1,147 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include "bounds.h"
+#include "qmatrix4x4.h"
+#include "scene.h"
+#include <QVector>
+#include <stdexcept>
+
+// SceneGraph arranges the models of a Scene in a tree of nodes. Every node
+// has a transform relative to its parent and may show one scene model; its
+// world matrix is the product of the transforms on its path from the root,
+// and it is what the renderer's vertex stage uses for the model.
+//
+// World matrices and bounds are cached. Changing a local transform only
+// marks the node dirty, and update() recomputes the dirty nodes and their
+// subtrees and passes the new world matrices on to the scene, whose BVH is
+// refit along the paths of the moved models. Work per update is therefore
+// proportional to the nodes that moved, not to the size of the graph.
+class SceneGraph {
+  public:
+    explicit SceneGraph(Scene *scene) : scene(scene) {
+        if (!scene) {
+            throw std::invalid_argument("Scene cannot be null.");
+        }
+    }
+
+    // Add a node below parent, or a root for -1, showing the scene model
+    // with index model, or nothing for -1. Returns the node's index.
+    int addNode(int parent = -1, const QMatrix4x4 &local = QMatrix4x4(),
+                int model = -1) {
+        if (parent >= nodes.size() || model >= scene->getModels().size())
+            throw std::out_of_range("No such parent node or model.");
+        Node node;
+        node.parent = parent;
+        node.model = model;
+        node.local = local;
+        int index = nodes.size();
+        if (parent >= 0) {
+            node.nextSibling = nodes[parent].firstChild;
+            nodes[parent].firstChild = index;
+        }
+        nodes.append(node);
+        markDirty(index);
+        return index;
+    }
+
+    int nodeCount() const { return nodes.size(); }
+
+    int getParent(int node) const { return nodes[node].parent; }
+
+    // Scene model shown by the node, or -1
+    int getModel(int node) const { return nodes[node].model; }
+
+    void setLocalTransform(int node, const QMatrix4x4 &local) {
+        nodes[node].local = local;
+        markDirty(node);
+    }
+
+    const QMatrix4x4 &getLocalTransform(int node) const {
+        return nodes[node].local;
+    }
+
+    // World matrix and world bounds of the node's model as of the last
+    // update(). Bounds are empty for nodes without a model.
+    const QMatrix4x4 &getWorldTransform(int node) const {
+        return nodes[node].world;
+    }
+
+    const Aabb &getWorldBounds(int node) const { return nodes[node].bounds; }
+
+    bool isDirty(int node) const { return nodes[node].dirty; }
+
+    // Recompute the world matrices of the dirty nodes and their subtrees
+    // and hand those of their models to the scene. Returns the number of
+    // nodes recomputed.
+    int update() {
+        int updated = 0;
+        for (int node : dirtyNodes) {
+            // A dirty ancestor recomputes this subtree along with its own
+            if (nodes[node].dirty && !hasDirtyAncestor(node))
+                updated += updateSubtree(node);
+        }
+        dirtyNodes.clear();
+        return updated;
+    }
+
+  private:
+    struct Node {
+        int parent = -1;
+        int firstChild = -1;
+        int nextSibling = -1;
+        int model = -1;     // Scene model index, -1 for a group node
+        QMatrix4x4 local;   // Relative to the parent
+        QMatrix4x4 world;   // Cached product of the locals from the root
+        Aabb bounds;        // World bounds of the model
+        bool dirty = false; // local changed since the last update
+    };
+
+    Scene *scene;
+    QVector<Node> nodes;
+    QVector<int> dirtyNodes; // Marked since the last update, once each
+    QVector<int> stack;      // Traversal stack of updateSubtree
+
+    void markDirty(int node) {
+        if (!nodes[node].dirty) {
+            nodes[node].dirty = true;
+            dirtyNodes.append(node);
+        }
+    }
+
+    bool hasDirtyAncestor(int node) const {
+        for (int parent = nodes[node].parent; parent >= 0;
+             parent = nodes[parent].parent) {
+            if (nodes[parent].dirty)
+                return true;
+        }
+        return false;
+    }
+
+    int updateSubtree(int root) {
+        int updated = 0;
+        stack.clear();
+        stack.append(root);
+        while (!stack.isEmpty()) {
+            int index = stack.last();
+            stack.removeLast();
+            Node &node = nodes[index];
+            node.world = node.parent >= 0
+                             ? nodes[node.parent].world * node.local
+                             : node.local;
+            node.dirty = false;
+            if (node.model >= 0) {
+                scene->setModelTransform(node.model, node.world);
+                node.bounds = scene->getWorldBounds(node.model);
+            }
+            updated++;
+            for (int child = node.firstChild; child >= 0;
+                 child = nodes[child].nextSibling) {
+                stack.append(child);
+            }
+        }
+        return updated;
+    }
+};
+
+#endif // SCENEGRAPH_H
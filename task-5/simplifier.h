@@ -0,0 +1,380 @@
+#ifndef SIMPLIFIER_H
+#define SIMPLIFIER_H
+
+#include "meshdata.h"
+#include "qvectornd.h"
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+// MeshSimplifier builds coarser versions of a mesh by edge collapse with
+// quadric error metrics (Garland and Heckbert). Every vertex carries the sum
+// of the squared distances to the planes of its original triangles, and the
+// edge whose collapse adds the least of that error is collapsed first.
+//
+// Collapses that would flip a triangle or make the surface non-manifold are
+// rejected, so the remaining triangles keep their orientation and a closed
+// mesh stays closed. Borders of open meshes are held in place by extra
+// planes perpendicular to them. Surviving triangles keep their colors.
+class MeshSimplifier {
+  public:
+    // Simplify mesh step by step and return a copy each time the triangle
+    // count drops to ratio times that of the previous level, up to levels
+    // copies. Fewer are returned once no collapse is left to make or a level
+    // would have fewer than MinTriangles triangles.
+    static QVector<std::shared_ptr<const MeshData>>
+    buildLevels(const MeshData &mesh, int levels, float ratio) {
+        MeshSimplifier simplifier(mesh);
+        QVector<std::shared_ptr<const MeshData>> result;
+        int previous = simplifier.liveTriangles;
+        for (int level = 0; level < levels; ++level) {
+            int target = int(previous * ratio);
+            if (target < MinTriangles)
+                break;
+            simplifier.collapseTo(target);
+            // A level that saves little is not worth its memory
+            if (simplifier.liveTriangles > previous * 0.9f ||
+                simplifier.liveTriangles == 0)
+                break;
+            previous = simplifier.liveTriangles;
+            result.append(simplifier.snapshot());
+        }
+        return result;
+    }
+
+  private:
+    // Below this a mesh loses its shape faster than it saves time
+    static constexpr int MinTriangles = 32;
+
+    // Symmetric 4x4 matrix, upper triangle in row order
+    struct Quadric {
+        double m[10] = {};
+
+        // Plane a x + b y + c z + d = 0, weighted
+        static Quadric plane(double a, double b, double c, double d,
+                             double weight) {
+            Quadric q;
+            double p[4] = {a, b, c, d};
+            int k = 0;
+            for (int i = 0; i < 4; ++i) {
+                for (int j = i; j < 4; ++j) {
+                    q.m[k++] = weight * p[i] * p[j];
+                }
+            }
+            return q;
+        }
+
+        void add(const Quadric &other) {
+            for (int i = 0; i < 10; ++i) {
+                m[i] += other.m[i];
+            }
+        }
+
+        double error(const QVector3D &v) const {
+            double x = v.x(), y = v.y(), z = v.z();
+            return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z +
+                   2 * m[3] * x + m[4] * y * y + 2 * m[5] * y * z +
+                   2 * m[6] * y + m[7] * z * z + 2 * m[8] * z + m[9];
+        }
+
+        // Point of least error, if the 3x3 part can be inverted
+        bool minimum(QVector3D &v) const {
+            double a = m[0], b = m[1], c = m[2], e = m[4], f = m[5], i = m[7];
+            double det = a * (e * i - f * f) - b * (b * i - f * c) +
+                         c * (b * f - e * c);
+            double scale = std::abs(a) + std::abs(e) + std::abs(i);
+            if (std::abs(det) <= 1e-12 * scale * scale * scale)
+                return false;
+            double r0 = -m[3], r1 = -m[6], r2 = -m[8];
+            // Cramer's rule
+            double x = (r0 * (e * i - f * f) - b * (r1 * i - f * r2) +
+                        c * (r1 * f - e * r2)) /
+                       det;
+            double y = (a * (r1 * i - r2 * f) - r0 * (b * i - f * c) +
+                        c * (b * r2 - r1 * c)) /
+                       det;
+            double z = (a * (e * r2 - f * r1) - b * (b * r2 - r1 * c) +
+                        r0 * (b * f - e * c)) /
+                       det;
+            v = QVector3D(x, y, z);
+            return true;
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        int from, to; // from is merged into to
+        int fromVersion, toVersion;
+        QVector3D position;
+
+        bool operator>(const Collapse &other) const {
+            return cost > other.cost;
+        }
+    };
+
+    const MeshData &source;
+    std::vector<QVector3D> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<int> versions; // Bumped when a vertex moves, -1 when merged
+    std::vector<std::vector<int>> vertexTriangles; // May list dead triangles
+    std::vector<quint32> corners;                  // 3 per triangle
+    std::vector<bool> liveTriangle;
+    int liveTriangles = 0;
+    Aabb bounds;           // Of the source
+    BoundingSphere sphere; // Of the source
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>>
+        queue;
+
+    explicit MeshSimplifier(const MeshData &mesh) : source(mesh) {
+        ArrayView<QVector3D> vertices = mesh.vertices();
+        ArrayView<quint32> indices = mesh.indices();
+        positions.assign(vertices.begin(), vertices.end());
+        corners.assign(indices.begin(), indices.end() - indices.size() % 3);
+        int triangles = corners.size() / 3;
+        quadrics.resize(positions.size());
+        versions.assign(positions.size(), 0);
+        vertexTriangles.resize(positions.size());
+        liveTriangle.assign(triangles, true);
+        liveTriangles = triangles;
+        bounds = mesh.bounds();
+        sphere = mesh.boundingSphere();
+
+        // Planes of the triangles, weighted by area
+        for (int t = 0; t < triangles; ++t) {
+            QVector3D normal = rawNormal(t);
+            float area = normal.length();
+            for (int k = 0; k < 3; ++k) {
+                vertexTriangles[corners[3 * t + k]].push_back(t);
+            }
+            if (area == 0)
+                continue;
+            normal = normal / area;
+            Quadric q = Quadric::plane(
+                normal.x(), normal.y(), normal.z(),
+                -QVector3D::dotProduct(normal, positions[corners[3 * t]]),
+                area / 2);
+            for (int k = 0; k < 3; ++k) {
+                quadrics[corners[3 * t + k]].add(q);
+            }
+        }
+        addBorderPlanes();
+
+        std::unordered_set<quint64> edges;
+        edges.reserve(corners.size());
+        for (int t = 0; t < triangles; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                quint32 a = corners[3 * t + k];
+                quint32 b = corners[3 * t + (k + 1) % 3];
+                if (edges.insert(edgeKey(a, b)).second)
+                    pushEdge(a, b);
+            }
+        }
+    }
+
+    static quint64 edgeKey(quint32 a, quint32 b) {
+        return a < b ? (quint64)a << 32 | b : (quint64)b << 32 | a;
+    }
+
+    // Cross product of two triangle edges, twice the area long
+    QVector3D rawNormal(int t) const {
+        const QVector3D &a = positions[corners[3 * t]];
+        return QVector3D::crossProduct(positions[corners[3 * t + 1]] - a,
+                                       positions[corners[3 * t + 2]] - a);
+    }
+
+    // Edges used by one triangle only lie on a border. A plane through the
+    // edge and perpendicular to the triangle keeps collapses from pulling
+    // the border inwards.
+    void addBorderPlanes() {
+        std::unordered_set<quint64> directed;
+        directed.reserve(corners.size());
+        for (size_t i = 0; i < corners.size(); ++i) {
+            quint32 a = corners[i], b = corners[i - i % 3 + (i + 1) % 3];
+            directed.insert((quint64)a << 32 | b);
+        }
+        for (size_t i = 0; i < corners.size(); ++i) {
+            quint32 a = corners[i], b = corners[i - i % 3 + (i + 1) % 3];
+            if (directed.count((quint64)b << 32 | a))
+                continue;
+            QVector3D edge = positions[b] - positions[a];
+            QVector3D normal = QVector3D::crossProduct(edge, rawNormal(i / 3));
+            if (normal.lengthSquared() == 0)
+                continue;
+            normal.normalize();
+            Quadric q = Quadric::plane(
+                normal.x(), normal.y(), normal.z(),
+                -QVector3D::dotProduct(normal, positions[a]),
+                10 * edge.lengthSquared());
+            quadrics[a].add(q);
+            quadrics[b].add(q);
+        }
+    }
+
+    // Queue the collapse of edge a-b at its cheapest position. The optimum
+    // of the summed quadric is used if it exists and lies within the source
+    // bounds, otherwise the better of the end points and the midpoint. Both
+    // bounding volumes are convex, so every level stays inside the bounds
+    // that culling tests for the level 0 mesh.
+    void pushEdge(int a, int b) {
+        Quadric q = quadrics[a];
+        q.add(quadrics[b]);
+        QVector3D candidates[4] = {positions[a], positions[b],
+                                   (positions[a] + positions[b]) * 0.5f};
+        int count = 3;
+        QVector3D optimum;
+        if (q.minimum(optimum) && contains(optimum))
+            candidates[count++] = optimum;
+        int best = 0;
+        double cost = q.error(candidates[0]);
+        for (int i = 1; i < count; ++i) {
+            double e = q.error(candidates[i]);
+            if (e < cost) {
+                cost = e;
+                best = i;
+            }
+        }
+        queue.push({std::max(cost, 0.0), a, b, versions[a], versions[b],
+                    candidates[best]});
+    }
+
+    bool contains(const QVector3D &p) const {
+        return p.x() >= bounds.min.x() && p.y() >= bounds.min.y() &&
+               p.z() >= bounds.min.z() && p.x() <= bounds.max.x() &&
+               p.y() <= bounds.max.y() && p.z() <= bounds.max.z() &&
+               (p - sphere.center).length() <= sphere.radius;
+    }
+
+    // Vertices sharing a live triangle with v
+    void neighbors(int v, std::vector<int> &out) const {
+        out.clear();
+        for (int t : vertexTriangles[v]) {
+            if (!liveTriangle[t])
+                continue;
+            for (int k = 0; k < 3; ++k) {
+                int w = corners[3 * t + k];
+                if (w != v &&
+                    std::find(out.begin(), out.end(), w) == out.end())
+                    out.push_back(w);
+            }
+        }
+    }
+
+    // Collapsing from into to keeps the surface a manifold only if the two
+    // share no neighbours besides the far corners of their edge's triangles
+    // (the link condition), and keeps its orientation only if no other
+    // triangle around them turns over.
+    bool canCollapse(const Collapse &c, std::vector<int> &fromNeighbors,
+                     std::vector<int> &toNeighbors) const {
+        neighbors(c.from, fromNeighbors);
+        neighbors(c.to, toNeighbors);
+        int shared = 0;
+        for (int w : fromNeighbors) {
+            shared += std::count(toNeighbors.begin(), toNeighbors.end(), w);
+        }
+        int edgeTriangles = 0;
+        for (int t : vertexTriangles[c.from]) {
+            if (liveTriangle[t] && hasCorner(t, c.to))
+                edgeTriangles++;
+        }
+        if (edgeTriangles == 0 || shared != edgeTriangles)
+            return false;
+
+        for (int v : {c.from, c.to}) {
+            for (int t : vertexTriangles[v]) {
+                if (!liveTriangle[t] || (hasCorner(t, c.from) &&
+                                         hasCorner(t, c.to)))
+                    continue;
+                QVector3D p[3];
+                for (int k = 0; k < 3; ++k) {
+                    int w = corners[3 * t + k];
+                    p[k] = w == c.from || w == c.to ? c.position
+                                                    : positions[w];
+                }
+                QVector3D after =
+                    QVector3D::crossProduct(p[1] - p[0], p[2] - p[0]);
+                if (QVector3D::dotProduct(after, rawNormal(t)) <= 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool hasCorner(int t, int v) const {
+        return int(corners[3 * t]) == v || int(corners[3 * t + 1]) == v ||
+               int(corners[3 * t + 2]) == v;
+    }
+
+    // Collapse the cheapest valid edges until at most target triangles are
+    // left or no edge can be collapsed. A closed mesh stops at a
+    // tetrahedron, whose collapses would all fold it flat.
+    void collapseTo(int target) {
+        std::vector<int> fromNeighbors, toNeighbors;
+        target = std::max(target, 4);
+        while (liveTriangles > target && !queue.empty()) {
+            Collapse c = queue.top();
+            queue.pop();
+            if (versions[c.from] != c.fromVersion ||
+                versions[c.to] != c.toVersion)
+                continue; // An end point moved since this was queued
+            if (!canCollapse(c, fromNeighbors, toNeighbors))
+                continue;
+
+            for (int t : vertexTriangles[c.from]) {
+                if (!liveTriangle[t])
+                    continue;
+                if (hasCorner(t, c.to)) {
+                    liveTriangle[t] = false;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    if (int(corners[3 * t + k]) == c.from)
+                        corners[3 * t + k] = c.to;
+                }
+                vertexTriangles[c.to].push_back(t);
+            }
+            vertexTriangles[c.from].clear();
+            positions[c.to] = c.position;
+            quadrics[c.to].add(quadrics[c.from]);
+            versions[c.from] = -1;
+            versions[c.to]++;
+
+            neighbors(c.to, toNeighbors);
+            for (int w : toNeighbors) {
+                pushEdge(c.to, w);
+            }
+        }
+    }
+
+    // Mesh of the live triangles and the vertices they use
+    std::shared_ptr<const MeshData> snapshot() const {
+        ArrayView<quint32> sourceColors = source.colors();
+        std::vector<int> remap(positions.size(), -1);
+        QVector<QVector3D> vertices;
+        QVector<quint32> indices;
+        QVector<quint32> colors;
+        indices.reserve(3 * liveTriangles);
+        colors.reserve(liveTriangles);
+        for (int t = 0; t < int(liveTriangle.size()); ++t) {
+            if (!liveTriangle[t])
+                continue;
+            for (int k = 0; k < 3; ++k) {
+                int v = corners[3 * t + k];
+                if (remap[v] < 0) {
+                    remap[v] = vertices.size();
+                    vertices.append(positions[v]);
+                }
+                indices.append(remap[v]);
+            }
+            colors.append(t < sourceColors.size() ? sourceColors[t]
+                                                  : MeshData::paletteColor(t));
+        }
+        return MeshData::create(vertices, indices, source.winding(), colors);
+    }
+};
+
+#endif // SIMPLIFIER_H
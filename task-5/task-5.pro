@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,6 +16,25 @@ HEADERS += \
     mainwindow.h \
     scene.h \ 
     rasterizer.h \ 
+    cameracontroller.h \
+    renderer.h \
+    profiler.h \
+    rendertarget.h \
+    halfspace.h \
+    fixedpoint.h \
+    tilebinner.h \
+    vertexstage.h \
+    objloader.h \
+    bounds.h \
+    meshdata.h \
+    meshcache.h \
+    simplifier.h \
+    frustum.h \
+    clipper.h \
+    bvh.h \
+    scenegraph.h \
+    depthpyramid.h \
+    occlusionbuffer.h \
     camera.h
 
 FORMS += \
@@ -0,0 +1,71 @@
+#ifndef TILEBINNER_H
+#define TILEBINNER_H
+
+#include "qrect.h"
+#include <QVector>
+#include <algorithm>
+
+// TileBinner splits the screen into square tiles and records which triangles
+// overlap each of them. Triangle indices are appended in submission order, so
+// walking a tile's bin front to back gives the same depth test results as
+// drawing the whole triangle list serially.
+class TileBinner {
+  public:
+    static constexpr int DefaultTileSize = 64;
+
+    explicit TileBinner(int tileSize = DefaultTileSize) : size(tileSize) {}
+
+    // Set up the tile grid for the given screen size and empty all bins.
+    // Bins keep their capacity, so steady-state frames do not reallocate.
+    void reset(int width, int height) {
+        screenWidth = std::max(0, width);
+        screenHeight = std::max(0, height);
+        columns = (screenWidth + size - 1) / size;
+        rows = (screenHeight + size - 1) / size;
+
+        bins.resize(columns * rows);
+        for (QVector<int> &bin : bins) {
+            bin.clear();
+        }
+    }
+
+    // Add a triangle to every tile touched by the inclusive pixel bounds
+    void insert(int triangle, int minX, int minY, int maxX, int maxY) {
+        minX = std::max(minX, 0);
+        minY = std::max(minY, 0);
+        maxX = std::min(maxX, screenWidth - 1);
+        maxY = std::min(maxY, screenHeight - 1);
+        if (minX > maxX || minY > maxY)
+            return;
+
+        for (int ty = minY / size; ty <= maxY / size; ++ty) {
+            for (int tx = minX / size; tx <= maxX / size; ++tx) {
+                bins[ty * columns + tx].append(triangle);
+            }
+        }
+    }
+
+    int tileSize() const { return size; }
+
+    int tileCount() const { return columns * rows; }
+
+    const QVector<int> &bin(int tile) const { return bins[tile]; }
+
+    // Screen area covered by a tile, cut to the screen edges
+    QRect tileRect(int tile) const {
+        int x = (tile % columns) * size;
+        int y = (tile / columns) * size;
+        return QRect(x, y, std::min(size, screenWidth - x),
+                     std::min(size, screenHeight - y));
+    }
+
+  private:
+    int size;
+    int screenWidth = 0;
+    int screenHeight = 0;
+    int columns = 0;
+    int rows = 0;
+    QVector<QVector<int>> bins; // Triangle indices per tile, row-major
+};
+
+#endif // TILEBINNER_H
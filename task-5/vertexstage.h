@@ -0,0 +1,259 @@
+#ifndef VERTEXSTAGE_H
+#define VERTEXSTAGE_H
+
+#include "camera.h"
+#include "frustum.h"
+#include "qmatrix4x4.h"
+#include "qrect.h"
+#include "qvectornd.h"
+#include <QVector>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VERTEXSTAGE_HAS_SSE_PATH 1
+#else
+#define VERTEXSTAGE_HAS_SSE_PATH 0
+#endif
+
+// Screen-space vertices in structure-of-arrays layout. x and y are pixel
+// coordinates and z is the view depth used for the depth test. Vertices on or
+// behind the near plane cannot be divided by their depth; they keep their
+// homogeneous coordinates (x * w, y * w, w) for the Clipper instead.
+struct ScreenVertices {
+    QVector<float> x, y, z;
+
+    void resize(int count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+
+    int size() const { return x.size(); }
+
+    QVector3D at(int i) const { return QVector3D(x[i], y[i], z[i]); }
+};
+
+// VertexStage turns world-space positions into screen space. The camera
+// transform, the perspective projection and the viewport mapping are folded
+// into one matrix once per frame, and each vertex then costs a single
+// matrix-vector product and a divide.
+class VertexStage {
+  public:
+    static constexpr float NearPlane = 0.1f;
+
+    // Build the combined matrix for the current camera and target size.
+    // depthOffset is added to camera-space points before projection.
+    void begin(const Camera &camera, const QVector3D &depthOffset, int width,
+               int height) {
+        // View: translate by -position, then apply the inverse rotation
+        QMatrix4x4 view = camera.getRotationMatrix().transposed();
+        QVector3D t = view.map(-camera.getPosition()) + depthOffset;
+        view(0, 3) = t.x();
+        view(1, 3) = t.y();
+        view(2, 3) = t.z();
+
+        viewportWidth = width;
+        viewportHeight = height;
+        float aspectRatio = (float)width / height;
+        float f = 1.0f / tan(camera.getFov() / 2.0f);
+        float scaleX = 1.0f / (aspectRatio * f);
+        float scaleY = 1.0f / f;
+        float halfWidth = width / 2.0f;
+        float halfHeight = height / 2.0f;
+        focalLength = halfHeight * scaleY;
+
+        // Row 3 gives w (camera depth). Rows 0 and 1 give the projected
+        // position already mapped to pixels and multiplied by w, so the
+        // perspective divide yields screen coordinates directly. Row 2 keeps
+        // w as the output depth.
+        for (int c = 0; c < 4; ++c) {
+            float w = view(2, c);
+            screen(0, c) = halfWidth * (scaleX * view(0, c) + w);
+            screen(1, c) = halfHeight * (w - scaleY * view(1, c));
+            screen(2, c) = w;
+            screen(3, c) = w;
+        }
+        objectToScreen = screen;
+    }
+
+    // Place the points of the following transform() calls in the world.
+    // begin() resets this to the identity.
+    void setModelMatrix(const QMatrix4x4 &model) {
+        objectToScreen = screen * model;
+    }
+
+    const QMatrix4x4 &screenMatrix() const { return screen; }
+
+    // World-space volume that can reach the viewport this frame, derived
+    // from the same field of view and aspect ratio as the projection
+    Frustum frustum() const {
+        return Frustum::fromScreenMatrix(screen, viewportWidth, viewportHeight,
+                                         NearPlane);
+    }
+
+    // Ray through pixel (x, y), starting on the near plane.
+    // Points along it are origin + t * direction, where t = 1 lies one unit
+    // of view depth beyond the near plane.
+    bool pixelRay(float x, float y, QVector3D &origin,
+                  QVector3D &direction) const {
+        QVector3D beyond;
+        if (!unproject(x, y, NearPlane, origin) ||
+            !unproject(x, y, NearPlane + 1.0f, beyond))
+            return false;
+        direction = beyond - origin;
+        return true;
+    }
+
+    // Project a single world-space point with the current frame's matrix.
+    // Points on or behind the near plane give (0, 0, 0).
+    QVector3D project(const QVector3D &point) const {
+        QVector3D p = transformPoint(screen, point);
+        if (!(p.z() > NearPlane))
+            return QVector3D(0, 0, 0);
+        return p;
+    }
+
+    // Radius in pixels of a world-space sphere seen at the view depth of its
+    // center. Infinite if the sphere reaches the near plane.
+    float projectedRadius(const BoundingSphere &sphere) const {
+        const QVector3D &c = sphere.center;
+        float depth = screen(3, 0) * c.x() + screen(3, 1) * c.y() +
+                      screen(3, 2) * c.z() + screen(3, 3);
+        if (depth - sphere.radius <= NearPlane)
+            return std::numeric_limits<float>::infinity();
+        return sphere.radius * focalLength / depth;
+    }
+
+    // Screen rectangle and nearest view depth of a world-space box. Returns
+    // false if part of the box is on or behind the near plane.
+    bool screenBounds(const Aabb &box, QRectF &rect, float &nearest) const {
+        if (box.isEmpty())
+            return false;
+        float minX = std::numeric_limits<float>::max(), maxX = -minX;
+        float minY = minX, maxY = maxX;
+        nearest = minX;
+        for (int corner = 0; corner < 8; ++corner) {
+            QVector3D point(corner & 1 ? box.max.x() : box.min.x(),
+                            corner & 2 ? box.max.y() : box.min.y(),
+                            corner & 4 ? box.max.z() : box.min.z());
+            QVector3D p = transformPoint(screen, point);
+            if (!(p.z() > NearPlane))
+                return false;
+            minX = std::min(minX, p.x());
+            maxX = std::max(maxX, p.x());
+            minY = std::min(minY, p.y());
+            maxY = std::max(maxY, p.y());
+            nearest = std::min(nearest, p.z());
+        }
+        rect = QRectF(minX, minY, maxX - minX, maxY - minY);
+        return true;
+    }
+
+    // Project an array of model-space points into out, which is resized to
+    // match
+    void transform(const QVector3D *points, int count,
+                   ScreenVertices &out) const {
+        out.resize(count);
+        int i = 0;
+#if VERTEXSTAGE_HAS_SSE_PATH
+        static_assert(sizeof(QVector3D) == 3 * sizeof(float),
+                      "QVector3D must be three packed floats");
+        const float *src = reinterpret_cast<const float *>(points);
+
+        __m128 m[3][4];
+        for (int r = 0; r < 3; ++r) {
+            int row = r == 2 ? 3 : r; // Depth equals w
+            for (int c = 0; c < 4; ++c)
+                m[r][c] = _mm_set1_ps(objectToScreen(row, c));
+        }
+        const __m128 nearPlane = _mm_set1_ps(NearPlane);
+
+        // Four vertices per step: load 12 interleaved floats and transpose
+        // them into x, y and z vectors
+        for (; i + 4 <= count; i += 4) {
+            __m128 m0 = _mm_loadu_ps(src + 3 * i);     // x0 y0 z0 x1
+            __m128 m1 = _mm_loadu_ps(src + 3 * i + 4); // y1 z1 x2 y2
+            __m128 m2 = _mm_loadu_ps(src + 3 * i + 8); // z2 x3 y3 z3
+            __m128 t0 = _mm_shuffle_ps(m1, m2, _MM_SHUFFLE(2, 1, 3, 2));
+            __m128 t1 = _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 2, 1));
+            __m128 px = _mm_shuffle_ps(m0, t0, _MM_SHUFFLE(2, 0, 3, 0));
+            __m128 py = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+            __m128 pz = _mm_shuffle_ps(t1, m2, _MM_SHUFFLE(3, 0, 3, 1));
+
+            __m128 out4[3];
+            for (int r = 0; r < 3; ++r) {
+                __m128 xy = _mm_add_ps(_mm_mul_ps(m[r][0], px),
+                                       _mm_mul_ps(m[r][1], py));
+                out4[r] = _mm_add_ps(
+                    xy, _mm_add_ps(_mm_mul_ps(m[r][2], pz), m[r][3]));
+            }
+            // Divide only the lanes in front of the near plane
+            __m128 w = out4[2];
+            __m128 visible = _mm_cmpgt_ps(w, nearPlane);
+            __m128 sx = _mm_or_ps(_mm_and_ps(visible, _mm_div_ps(out4[0], w)),
+                                  _mm_andnot_ps(visible, out4[0]));
+            __m128 sy = _mm_or_ps(_mm_and_ps(visible, _mm_div_ps(out4[1], w)),
+                                  _mm_andnot_ps(visible, out4[1]));
+
+            _mm_storeu_ps(out.x.data() + i, sx);
+            _mm_storeu_ps(out.y.data() + i, sy);
+            _mm_storeu_ps(out.z.data() + i, w);
+        }
+#endif
+        for (; i < count; ++i) {
+            QVector3D p = transformPoint(objectToScreen, points[i]);
+            out.x[i] = p.x();
+            out.y[i] = p.y();
+            out.z[i] = p.z();
+        }
+    }
+
+  private:
+    // Screen position of a point, or its homogeneous coordinates if it is on
+    // or behind the near plane. The sums are grouped like in the SIMD path so
+    // both give identical results.
+    static QVector3D transformPoint(const QMatrix4x4 &m,
+                                    const QVector3D &point) {
+        float p[3];
+        for (int r = 0; r < 3; ++r) {
+            int row = r == 2 ? 3 : r; // Depth equals w
+            p[r] = (m(row, 0) * point.x() + m(row, 1) * point.y()) +
+                   (m(row, 2) * point.z() + m(row, 3));
+        }
+        float w = p[2];
+        if (!(w > NearPlane))
+            return QVector3D(p[0], p[1], w);
+        return QVector3D(p[0] / w, p[1] / w, w);
+    }
+
+    // World point at pixel (x, y) and view depth w. Rows 0, 1 and 3 of the
+    // screen matrix give three linear equations in the point's coordinates.
+    bool unproject(float x, float y, float w, QVector3D &point) const {
+        QVector4D rowX = screen.row(0) - x * screen.row(3);
+        QVector4D rowY = screen.row(1) - y * screen.row(3);
+        QVector4D rowW = screen.row(3);
+        QVector3D a0 = rowX.toVector3D(), a1 = rowY.toVector3D(),
+                  a2 = rowW.toVector3D();
+        float b0 = -rowX.w(), b1 = -rowY.w(), b2 = w - rowW.w();
+
+        float determinant = QVector3D::dotProduct(
+            a0, QVector3D::crossProduct(a1, a2));
+        if (determinant == 0)
+            return false;
+        point = (b0 * QVector3D::crossProduct(a1, a2) +
+                 b1 * QVector3D::crossProduct(a2, a0) +
+                 b2 * QVector3D::crossProduct(a0, a1)) /
+                determinant;
+        return true;
+    }
+
+    QMatrix4x4 screen;         // World space to (x * w, y * w, w, w) in pixels
+    QMatrix4x4 objectToScreen; // screen times the current model matrix
+    int viewportWidth = 0;
+    int viewportHeight = 0;
+    float focalLength = 0; // Pixels per unit at a view depth of one
+};
+
+#endif // VERTEXSTAGE_H